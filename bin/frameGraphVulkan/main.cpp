@@ -655,8 +655,6 @@ int main(int argc, char *argv[])
             }
 #endif
         F.endRenderPass();
-
-        F.fullBarrier();
     });
     FGE.setRenderer("HBlur1", [&](FrameGraphExecutor_Vulkan::Frame & F)
     {
@@ -687,8 +685,6 @@ int main(int argc, char *argv[])
             filterPipeline.pushConstants(F.commandBuffer, sizeof(_pc), &_pc);
             imposterMesh.draw(F.commandBuffer);
         F.endRenderPass();
-
-        F.fullBarrier();
     });
     FGE.setRenderer("VBlur1", [&](FrameGraphExecutor_Vulkan::Frame & F)
     {
@@ -714,8 +710,6 @@ int main(int argc, char *argv[])
             filterPipeline.pushConstants(F.commandBuffer, sizeof(_pc), &_pc);
             imposterMesh.draw(F.commandBuffer);
         F.endRenderPass();
-
-        F.fullBarrier();
     });
     FGE.setRenderer("Final", [&](FrameGraphExecutor_Vulkan::Frame & F)
     {
@@ -3,6 +3,11 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include "../frameGraph.h"
 
 namespace gfg
@@ -11,15 +16,17 @@ struct ExecutorBase
 {
     /**
      * @brief generateImage
-     * @param imageName
-     * @param format
-     * @param width
-     * @param height
+     * @param imageDef
      *
      * This function is used to generate an image that will be rendered to.
-     * It will be identified by imageName.
+     * It will be identified by imageDef.name. The width/height of
+     * the definition have already been resolved to the window's size
+     * if needed.
+     *
+     * If imageDef.imported is set, the image belongs to the application
+     * and the executor should use the image it was given instead.
      */
-    virtual void generateImage(std::string const & imageName, FrameGraphFormat format, uint32_t width, uint32_t height) = 0;
+    virtual void generateImage(ImageDefinition const & imageDef) = 0;
 
     /**
      * @brief destroyImage
@@ -33,21 +40,57 @@ struct ExecutorBase
      */
     virtual void destroyImage(std::string const & imageName) = 0;
 
+    /**
+     * @brief postImageGeneration
+     * @param images
+     *
+     * This function is called after all the images have been generated
+     * and before any framebuffers are built. Executors which defer
+     * allocating memory for their images can use the lifetimes in
+     * the image definitions to do so here.
+     */
+    virtual void postImageGeneration(std::vector<ImageDefinition> const & images) = 0;
+
+    /**
+     * @brief generateBuffer
+     * @param bufferDef
+     *
+     * This function is used to generate a GPU buffer which will be
+     * written/read by the passes. It will be identified by bufferDef.name.
+     * bufferDef.usage contains all the ways the buffer is used by the
+     * graph buffers which share it.
+     */
+    virtual void generateBuffer(BufferDefinition const & bufferDef) = 0;
+
+    /**
+     * @brief destroyBuffer
+     * @param bufferName
+     *
+     * Called before the buffers are regenerated in resize( ). If
+     * the buffer does not exist, this function should return gracefully.
+     */
+    virtual void destroyBuffer(std::string const & bufferName) = 0;
+
     /**
      * @brief buildFrameBuffer
      * @param renderPassName
      * @param outputTargetImages
      * @param inputSampledImages
+     * @param inputSamplers
      *
      * This function is called when a framebuffer needs to be built.
      * The outputTargetImages are the names of the images that should be used
-     * for rendering to.
+     * for rendering to. If the pass is multisampled, a single sampled
+     * image in outputTargetImages is not rendered to: the multisampled
+     * image before it is resolved into it at the end of the pass.
      *
      * inputSampled images are the list of images that are going to be sampled
-     * from.
+     * from. If the executor merges render passes, targets read as input
+     * attachments of a merged render pass are not included. inputSamplers
+     * has the sampler of each of them.
      *
      */
-    virtual void buildFrameBuffer(std::string const & renderPassName, std::vector<std::string> const & outputTargetImages, std::vector<std::string> const & inputSampledImages) = 0;
+    virtual void buildFrameBuffer(std::string const & renderPassName, std::vector<std::string> const & outputTargetImages, std::vector<std::string> const & inputSampledImages, std::vector<SamplerDefinition> const & inputSamplers) = 0;
 
     /**
      * @brief destroyFrameBuffer
@@ -61,6 +104,59 @@ struct ExecutorBase
      */
     virtual void destroyFrameBuffer(std::string const & renderPassName) = 0;
 
+    /**
+     * @brief buildComputePass
+     * @param computePassName
+     * @param storageImages
+     * @param inputSampledImages
+     * @param inputSamplers
+     *
+     * This function is called instead of buildFrameBuffer( ) for compute
+     * passes. storageImages are the names of the images which are
+     * accessed as storage images, the outputs first followed by the
+     * inputs read with ComputePassNode::storageInput( ).
+     *
+     * inputSampledImages are the images which are going to be sampled from,
+     * with the samplers in inputSamplers.
+     */
+    virtual void buildComputePass(std::string const & computePassName, std::vector<std::string> const & storageImages, std::vector<std::string> const & inputSampledImages, std::vector<SamplerDefinition> const & inputSamplers) = 0;
+
+    /**
+     * @brief destroyPass
+     * @param passName
+     *
+     * Called by resize( ) for a pass which was built before but is no
+     * longer in the graph. The executor should release everything it
+     * built for the pass, eg: its framebuffer and descriptor sets.
+     */
+    virtual void destroyPass(std::string const & passName) = 0;
+
+    /**
+     * @brief buildExecutionPlan
+     * @param G
+     *
+     * This function is called after all the framebuffers have been built.
+     * The executor should resolve everything its operator() needs for each
+     * pass in m_execOrder, so that executing a frame does not need to look
+     * anything up by name.
+     *
+     * If the graph usesHistory( ), a second plan is needed for odd frames.
+     * It uses the nodes named by _nodeName(G, p, 1).
+     */
+    virtual void buildExecutionPlan(FrameGraph const & G) = 0;
+
+
+    /**
+     * @brief mergesRenderPasses
+     * @return
+     *
+     * Return true if the executor executes passes which the FrameGraph
+     * merged into a single render pass as subpasses.
+     */
+    virtual bool mergesRenderPasses() const
+    {
+        return false;
+    }
 
     /**
      * @brief preResize
@@ -79,6 +175,162 @@ struct ExecutorBase
     virtual void postResize() = 0;
 
 
+    /**
+     * @brief The ResizeStats struct
+     *
+     * The number of objects created and destroyed by all the calls
+     * to resize( ) so far. Subtract two copies to get the work done
+     * by a single resize.
+     */
+    struct ResizeStats
+    {
+        uint32_t resizes            = 0;
+        uint32_t imagesCreated      = 0;
+        uint32_t imagesDestroyed    = 0;
+        uint32_t buffersCreated     = 0;
+        uint32_t buffersDestroyed   = 0;
+        uint32_t passesBuilt        = 0; // calls to buildFrameBuffer( )/buildComputePass( )
+        uint32_t passesKept         = 0; // passes which did not need to be rebuilt
+        uint32_t passesDestroyed    = 0; // passes no longer in the graph, see destroyPass( )
+
+        // filled in by the executors which create these objects
+        uint32_t framebuffersCreated   = 0;
+        uint32_t framebuffersDestroyed = 0;
+        uint32_t renderPassesCreated   = 0;
+        uint32_t descriptorSetsWritten = 0;
+    };
+
+    ResizeStats const & getResizeStats() const
+    {
+        return m_stats;
+    }
+
+    /**
+     * @brief getFrameAllocations
+     *
+     * The number of times executing a pass had to grow one of the
+     * vectors of the Frame the executor reuses, ie: allocated. The
+     * executors reserve that Frame for the largest pass, so this
+     * stays 0 once the graph has been resized.
+     */
+    uint64_t getFrameAllocations() const
+    {
+        return m_frameAllocations.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief The PassTiming struct
+     *
+     * The GPU time of a pass in milliseconds, over the most
+     * recent frames measured by the executor.
+     */
+    struct PassTiming
+    {
+        std::string name;
+        double      min     = 0.0;
+        double      avg     = 0.0;
+        double      max     = 0.0;
+        uint32_t    samples = 0; // frames measured, at most the profiling window
+    };
+
+    /**
+     * @brief getPassTimings
+     *
+     * The GPU time of every pass, in execution order, when the
+     * executor's profiling is enabled. The timestamps are read back
+     * a few frames after they were recorded, so the first frames have
+     * no samples. resize( ) starts the measurements over.
+     */
+    std::vector<PassTiming> const & getPassTimings() const
+    {
+        return m_passTimings;
+    }
+
+    /**
+     * @brief setProfilingWindow
+     * @param frames
+     *
+     * The number of most recent frames the pass timings are computed
+     * over. Changing it starts the measurements over.
+     */
+    void setProfilingWindow(uint32_t frames)
+    {
+        assert(frames > 0);
+        m_timingWindow = frames;
+        _clearTimings();
+    }
+
+    /**
+     * @brief setGrowOnly
+     * @param enable
+     * @param granularity
+     *
+     * When enabled, images sized to the window are only reallocated
+     * when the window grows larger than them. Their extent is rounded
+     * up to a multiple of granularity, so a window which is resized
+     * slowly does not reallocate on every resize( ). Passes then only
+     * render to the top-left renderableWidth x renderableHeight of
+     * their images, see FrameBase.
+     *
+     * Imported targets sized to the window must be created with
+     * getImageWidth( ) x getImageHeight( ).
+     *
+     * This should be set before the first call to resize( )
+     */
+    void setGrowOnly(bool enable, uint32_t granularity = 1)
+    {
+        assert(granularity > 0);
+        m_growOnly    = enable;
+        m_granularity = granularity;
+    }
+
+    /**
+     * @brief setResolutionScale
+     * @param scale
+     *
+     * Scales the renderable extent of the passes sized to the window,
+     * eg: 0.5 renders at half the window's width and height. The images
+     * are not reallocated, so this can be changed every frame, eg: by a
+     * controller which keeps the frame time within budget. The extent
+     * is clamped to the images, so scales above 1 need setGrowOnly( )
+     * images which are large enough.
+     *
+     * Renderers must set their viewport/scissor to the renderable extent
+     * and scale the texture coordinates of window sized inputs by
+     * renderableWidth/imageWidth.
+     */
+    void setResolutionScale(float scale)
+    {
+        assert(scale > 0.0f);
+        m_resolutionScale = scale;
+        _updateRenderableExtent();
+    }
+
+    float getResolutionScale() const
+    {
+        return m_resolutionScale;
+    }
+
+    // the extent of the images sized to the window
+    uint32_t getImageWidth() const
+    {
+        return m_imageWidth;
+    }
+    uint32_t getImageHeight() const
+    {
+        return m_imageHeight;
+    }
+
+    // the part of those images the passes render to this frame
+    uint32_t getRenderableWidth() const
+    {
+        return m_renderableWidth;
+    }
+    uint32_t getRenderableHeight() const
+    {
+        return m_renderableHeight;
+    }
+
     /**
      * @brief resize
      * @param G
@@ -87,70 +339,522 @@ struct ExecutorBase
      *
      * Resizes the framgraph. This should be called whenever
      * your window changes size.
+     *
+     * Only the images whose resolved definition changed since the
+     * last resize are destroyed and generated again, eg: images sized
+     * to the window when the window's size changes. Images with a
+     * fixed extent are kept. A pass is only rebuilt if one of the
+     * images it uses was regenerated or its inputs/outputs changed.
+     * Passes merged into the same render pass are rebuilt together.
+     *
+     * With setGrowOnly( ), shrinking the window does not change any
+     * image, so nothing is rebuilt.
      */
     void resize(FrameGraph &G, uint32_t width, uint32_t height)
     {
-        m_execOrder = G.findExecutionOrder();
+        m_execOrder = G.getExecutionOrder();
+        _resetTimings(G);
 
         preResize();
 
         m_windowWidth = width;
         m_windowHeight = height;
+        m_stats.resizes++;
+
+        if(m_growOnly)
+        {
+            auto _roundUp = [this](uint32_t x)
+            {
+                return (x + m_granularity - 1) / m_granularity * m_granularity;
+            };
+            m_imageWidth  = std::max(m_imageWidth,  _roundUp(width));
+            m_imageHeight = std::max(m_imageHeight, _roundUp(height));
+        }
+        else
+        {
+            m_imageWidth  = width;
+            m_imageHeight = height;
+        }
+        _updateRenderableExtent();
+        G.updateImageAllocationInfo(m_imageWidth, m_imageHeight);
 
         // Second, go through all the images that need to be created
-        // and create/recreate them.
-        for (auto &[name, imgDef] : G.getImages())
+        // and create/recreate the ones which changed.
+        std::unordered_set<std::string> changedImages;
+        std::unordered_set<std::string> graphImages;
+        for (auto &imgDef : G.getImages())
         {
             auto iDef         = imgDef;
 
             if (iDef.width * iDef.height == 0)
             {
-                iDef.width  = width;
-                iDef.height = height;
+                iDef.width  = scaleExtent(m_imageWidth,  iDef.scale);
+                iDef.height = scaleExtent(m_imageHeight, iDef.scale);
             }
-            if(imgDef.resizable)
+            graphImages.insert(iDef.name);
+
+            // imported images are always taken again, the
+            // application may have given a new one
+            auto it = m_generatedImages.find(iDef.name);
+            if(it != m_generatedImages.end() && !iDef.imported && _sameImage(it->second, iDef))
+                continue;
+
+            if(it != m_generatedImages.end())
             {
-                destroyImage(name);
+                destroyImage(iDef.name);
+                m_stats.imagesDestroyed++;
             }
-            generateImage(name, iDef.format, iDef.width, iDef.height);
+            generateImage(iDef);
+            m_stats.imagesCreated++;
 
+            m_generatedImages[iDef.name] = iDef;
+            changedImages.insert(iDef.name);
+        }
+        // images the graph no longer has
+        for(auto it = m_generatedImages.begin(); it != m_generatedImages.end(); )
+        {
+            if(graphImages.count(it->first))
+            {
+                ++it;
+                continue;
+            }
+            destroyImage(it->first);
+            m_stats.imagesDestroyed++;
+            it = m_generatedImages.erase(it);
         }
+        postImageGeneration(G.getImages());
 
-        for (auto &name : m_execOrder)
+        // buffers do not depend on the window's size, they are
+        // only recreated when the graph changes them
+        std::unordered_set<std::string> changedBuffers;
+        std::unordered_set<std::string> graphBuffers;
+        for (auto &bufDef : G.getBuffers())
         {
-            auto &Nv = G.getNodes().at(name);
+            graphBuffers.insert(bufDef.name);
 
-            if (std::holds_alternative<RenderPassNode>(Nv))
+            auto it = m_generatedBuffers.find(bufDef.name);
+            if(it != m_generatedBuffers.end() && _sameBuffer(it->second, bufDef))
+                continue;
+
+            if(it != m_generatedBuffers.end())
+            {
+                destroyBuffer(bufDef.name);
+                m_stats.buffersDestroyed++;
+            }
+            generateBuffer(bufDef);
+            m_stats.buffersCreated++;
+
+            m_generatedBuffers[bufDef.name] = bufDef;
+            changedBuffers.insert(bufDef.name);
+        }
+        // buffers the graph no longer has
+        for(auto it = m_generatedBuffers.begin(); it != m_generatedBuffers.end(); )
+        {
+            if(graphBuffers.count(it->first))
+            {
+                ++it;
+                continue;
+            }
+            destroyBuffer(it->first);
+            m_stats.buffersDestroyed++;
+            it = m_generatedBuffers.erase(it);
+        }
+
+        auto & passes  = G.getPasses();
+        auto & targets = G.getTargets();
+        auto & images  = G.getImages();
+
+        // what each pass is built from
+        struct PassBuild
+        {
+            std::string                    name;
+            std::vector<std::string>       outputTargetNames;
+            std::vector<std::string>       inputSampledImageNames;
+            std::vector<SamplerDefinition> inputSamplers;
+            std::vector<LoadOp>            loadOps;
+            std::vector<StoreOp>           storeOps;
+            bool                           dirty = false;
+        };
+        std::vector<PassBuild> builds(passes.size());
+        std::unordered_set<std::string> graphPasses;
+
+        // passes which use history images are built a second
+        // time for odd frames, with the two images swapped
+        uint32_t parityCount = G.usesHistory() ? 2 : 1;
+        for (uint32_t parity=0; parity<parityCount; parity++)
+        {
+            // the image of the target, or its mip level
+            auto _imageName = [&](TargetHandle t, uint32_t imageParity)
             {
-                auto &N       = std::get<RenderPassNode>(Nv);
+                return _mipName(images[targets.getImage(t, imageParity).index].name, targets.mip[t.index]);
+            };
+            auto _changed = [&](std::string const & name)
+            {
+                uint32_t mip = 0;
+                return changedImages.count(_splitMipName(name, mip)) != 0;
+            };
+
+            for (auto p : m_execOrder)
+            {
+                auto & B = builds[p.index];
+                B = {};
+                if(parity && !passes.history[p.index])
+                    continue;
+
+                B.name = _nodeName(G, p, parity);
+                graphPasses.insert(B.name);
 
-                std::vector<std::string> outputTargetNames;
-                std::vector<std::string> inputSampledImageNames;
+                // a new reader can change the ops without changing the images
+                auto loadOps  = passes.getOutputLoadOps(p);
+                auto storeOps = passes.getOutputStoreOps(p);
+                B.loadOps.assign(loadOps.begin(), loadOps.end());
+                B.storeOps.assign(storeOps.begin(), storeOps.end());
+
+                for (auto t : passes.getOutputs(p))
+                {
+                    B.outputTargetNames.push_back(_imageName(t, parity));
+                }
+                auto subpassInputs = passes.getSubpassInputs(p);
+                auto inputTypes    = passes.getInputTypes(p);
+                auto samplers      = passes.getInputSamplers(p);
+                for (uint32_t i=0; i<subpassInputs.size(); i++)
+                {
+                    auto t = passes.getInputs(p)[i];
 
-                for (auto r : N.outputRenderTargets)
+                    // merged input attachments are not given to the
+                    // executor, but the pass still uses the image
+                    if(subpassInputs[i] && mergesRenderPasses())
+                    {
+                        B.dirty |= _changed(_imageName(t, parity));
+                        continue;
+                    }
+                    if(inputTypes[i] == InputType::STORAGE)
+                    {
+                        B.outputTargetNames.push_back(_imageName(t, parity));
+                        continue;
+                    }
+                    B.inputSampledImageNames.push_back(_imageName(t, parity));
+                    B.inputSamplers.push_back(samplers[i]);
+                }
+                auto historyInputs = passes.getHistoryInputs(p);
+                for (uint32_t i=0; i<historyInputs.size(); i++)
                 {
-                    auto &RTN = std::get<RenderTargetNode>(G.getNodes().at(r.name));
-                    outputTargetNames.push_back(RTN.imageResource.name);
+                    B.inputSampledImageNames.push_back(_imageName(historyInputs[i], 1 - parity));
+                    B.inputSamplers.push_back(passes.getHistoryInputSamplers(p)[i]);
                 }
-                for (auto r : N.inputSampledRenderTargets)
+
+                for (auto & n : B.outputTargetNames)
+                    B.dirty |= _changed(n);
+                for (auto & n : B.inputSampledImageNames)
+                    B.dirty |= _changed(n);
+                for (auto b : passes.getInputBuffers(p))
+                    B.dirty |= changedBuffers.count(G.getBuffers()[G.getBufferTable().allocation[b.index].index].name) != 0;
+                for (auto b : passes.getOutputBuffers(p))
+                    B.dirty |= changedBuffers.count(G.getBuffers()[G.getBufferTable().allocation[b.index].index].name) != 0;
+
+                auto built = m_builtPasses.find(B.name);
+                if(built == m_builtPasses.end() ||
+                   built->second.outputTargetNames != B.outputTargetNames ||
+                   built->second.inputSampledImageNames != B.inputSampledImageNames ||
+                   built->second.inputSamplers != B.inputSamplers ||
+                   built->second.loadOps != B.loadOps ||
+                   built->second.storeOps != B.storeOps ||
+                   built->second.type != passes.type[p.index] ||
+                   built->second.renderPass != passes.renderPass[p.index].index ||
+                   built->second.subpass != passes.subpass[p.index])
                 {
-                    auto &RTN = std::get<RenderTargetNode>(G.getNodes().at(r.name));
-                    inputSampledImageNames.push_back(RTN.imageResource.name);
+                    B.dirty = true;
                 }
+            }
 
-                destroyFrameBuffer(name);
-                buildFrameBuffer(name, outputTargetNames, inputSampledImageNames);
+            // the passes of a merged render pass share a framebuffer
+            if(mergesRenderPasses())
+            {
+                for (auto p : m_execOrder)
+                {
+                    auto rp = passes.renderPass[p.index];
+                    builds[rp.index].dirty |= builds[p.index].dirty;
+                }
+                for (auto p : m_execOrder)
+                {
+                    builds[p.index].dirty |= builds[passes.renderPass[p.index].index].dirty;
+                }
             }
 
+            for (auto p : m_execOrder)
+            {
+                auto & B = builds[p.index];
+                if(B.name.empty())
+                    continue;
+                if(!B.dirty)
+                {
+                    m_stats.passesKept++;
+                    continue;
+                }
+
+                auto & built = m_builtPasses[B.name];
+                built.outputTargetNames      = B.outputTargetNames;
+                built.inputSampledImageNames = B.inputSampledImageNames;
+                built.inputSamplers          = B.inputSamplers;
+                built.loadOps                = B.loadOps;
+                built.storeOps               = B.storeOps;
+                built.type                   = passes.type[p.index];
+                built.renderPass             = passes.renderPass[p.index].index;
+                built.subpass                = passes.subpass[p.index];
+                m_stats.passesBuilt++;
+
+                if(passes.type[p.index] == PassType::COMPUTE)
+                {
+                    buildComputePass(B.name, B.outputTargetNames, B.inputSampledImageNames, B.inputSamplers);
+                    continue;
+                }
+
+                destroyFrameBuffer(B.name);
+                buildFrameBuffer(B.name, B.outputTargetNames, B.inputSampledImageNames, B.inputSamplers);
+            }
+        }
+        // passes the graph no longer has
+        for(auto it = m_builtPasses.begin(); it != m_builtPasses.end(); )
+        {
+            if(graphPasses.count(it->first))
+            {
+                ++it;
+                continue;
+            }
+            destroyPass(it->first);
+            m_stats.passesDestroyed++;
+            it = m_builtPasses.erase(it);
         }
 
+        buildExecutionPlan(G);
+
         postResize();
     }
 
 protected:
-    std::vector<std::string> m_execOrder;
+    /**
+     * @brief _nodeName
+     * @return
+     *
+     * The name the pass was built with for frames of the given parity.
+     * Passes which use history images have a second version for odd frames.
+     */
+    static std::string _nodeName(FrameGraph const & G, PassHandle p, uint32_t parity)
+    {
+        auto & passes = G.getPasses();
+        if(parity && passes.history[p.index])
+            return passes.name[p.index] + "#odd";
+        return passes.name[p.index];
+    }
+
+    /**
+     * @brief _mipName
+     *
+     * The name given to the executor for a single mip level of an
+     * image, see RenderPassNode::outputMip( ). Mip 0 keeps the
+     * image's name.
+     */
+    static std::string _mipName(std::string const & image, uint32_t mip)
+    {
+        return mipTargetName(image, mip);
+    }
+
+    // splits a name made by _mipName( ) into the image's name and the mip level
+    static std::string _splitMipName(std::string const & name, uint32_t & mip)
+    {
+        mip = 0;
+        auto pos = name.rfind("#mip");
+        if(pos == std::string::npos)
+            return name;
+        mip = static_cast<uint32_t>(std::stoul(name.substr(pos + 4)));
+        return name.substr(0, pos);
+    }
+
+    // The pass which sets the extent p renders at. Passes which
+    // write a mip level render at the extent of the mip, which
+    // follows the writer of mip 0.
+    static PassHandle _extentPass(FrameGraph const & G, PassHandle p, uint32_t & mip)
+    {
+        auto & passes  = G.getPasses();
+        auto & targets = G.getTargets();
+        mip = 0;
+        auto outputs = passes.getOutputs(p);
+        if(outputs.size() == 0 || targets.mip[outputs[0].index] == 0)
+            return p;
+        mip = targets.mip[outputs[0].index];
+        return targets.writer[targets.baseMip[outputs[0].index].index];
+    }
+
+    // true if the pass renders to images sized to the window
+    static bool _windowSized(FrameGraph const & G, PassHandle p)
+    {
+        auto & passes = G.getPasses();
+        uint32_t mip = 0;
+        auto     e   = _extentPass(G, p, mip);
+        return passes.width[e.index] * passes.height[e.index] == 0;
+    }
+
+    // the scale of the window's size the pass renders at, if it is window sized
+    static float _windowScale(FrameGraph const & G, PassHandle p)
+    {
+        auto & passes = G.getPasses();
+        uint32_t mip = 0;
+        auto     e   = _extentPass(G, p, mip);
+        return passes.scale[e.index] / static_cast<float>(1u << mip);
+    }
+
+    // The renderable extent of a pass sized to the window, see setScale( ).
+    // Passes sized to the same image render to the same extent.
+    void _renderableExtent(float scale, uint32_t imageWidth, uint32_t imageHeight, uint32_t & width, uint32_t & height) const
+    {
+        width  = std::min(scaleExtent(m_renderableWidth,  scale), imageWidth);
+        height = std::min(scaleExtent(m_renderableHeight, scale), imageHeight);
+    }
+
+    // the window's extent scaled by the resolution scale,
+    // clamped to the images sized to the window
+    void _updateRenderableExtent()
+    {
+        m_renderableWidth  = std::min(scaleExtent(m_windowWidth,  m_resolutionScale), m_imageWidth);
+        m_renderableHeight = std::min(scaleExtent(m_windowHeight, m_resolutionScale), m_imageHeight);
+    }
+
+    // Forgets everything resize( ) generated, so the next resize
+    // generates all the images and buffers and builds every pass.
+    // Executors call this when they destroy their resources.
+    void _resetGenerated()
+    {
+        m_generatedImages.clear();
+        m_generatedBuffers.clear();
+        m_builtPasses.clear();
+    }
+
+    // Copies the prebuilt frame of a pass into the frame operator()
+    // reuses. vectors are the Frame's vector members: copying one which
+    // is larger than the capacity reserved for it allocates, and is
+    // counted in getFrameAllocations( ). Passes may be recorded by
+    // several threads at once.
+    template<typename Frame, typename... Vectors>
+    void _copyFrame(Frame & dst, Frame const & src, Vectors Frame::*... vectors) const
+    {
+        bool grows = (false || ... || ((src.*vectors).size() > (dst.*vectors).capacity()));
+        if(grows)
+        {
+            m_frameAllocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        dst = src;
+    }
+
+    // Starts measuring the passes of the execution order over
+    void _resetTimings(FrameGraph const & G)
+    {
+        m_passTimings.resize(m_execOrder.size());
+        for(size_t i=0;i<m_execOrder.size();i++)
+        {
+            m_passTimings[i].name = G.getPasses().name[m_execOrder[i].index];
+        }
+        _clearTimings();
+    }
+
+    void _clearTimings()
+    {
+        for(auto & T : m_passTimings)
+        {
+            T = {T.name};
+        }
+        m_timingSamples.assign(m_passTimings.size() * m_timingWindow, 0.0);
+        m_timingCount.assign(m_passTimings.size(), 0);
+    }
+
+    // Adds the GPU time of the i-th pass of the execution order,
+    // measured for one frame, to the pass's window of samples
+    void _addTiming(size_t i, double milliseconds)
+    {
+        auto & T      = m_passTimings[i];
+        auto * window = m_timingSamples.data() + i * m_timingWindow;
+        window[m_timingCount[i]++ % m_timingWindow] = milliseconds;
+
+        T.samples = static_cast<uint32_t>(std::min<uint64_t>(m_timingCount[i], m_timingWindow));
+        T.min     = window[0];
+        T.max     = window[0];
+        double sum = 0.0;
+        for(uint32_t k=0;k<T.samples;k++)
+        {
+            T.min = std::min(T.min, window[k]);
+            T.max = std::max(T.max, window[k]);
+            sum  += window[k];
+        }
+        T.avg = sum / T.samples;
+    }
+
+    static bool _sameImage(ImageDefinition const & a, ImageDefinition const & b)
+    {
+        return a.format          == b.format &&
+               a.mipLevels       == b.mipLevels &&
+               a.samples         == b.samples &&
+               a.resizable       == b.resizable &&
+               a.width           == b.width &&
+               a.height          == b.height &&
+               a.firstUse        == b.firstUse &&
+               a.lastUse         == b.lastUse &&
+               a.transient       == b.transient &&
+               a.sampled         == b.sampled &&
+               a.attachment      == b.attachment &&
+               a.inputAttachment == b.inputAttachment &&
+               a.storage         == b.storage &&
+               a.asyncCompute    == b.asyncCompute &&
+               a.imported        == b.imported &&
+               a.history         == b.history;
+    }
+
+    static bool _sameBuffer(BufferDefinition const & a, BufferDefinition const & b)
+    {
+        return a.size         == b.size &&
+               a.usage        == b.usage &&
+               a.asyncCompute == b.asyncCompute;
+    }
+
+    // the names, samplers and attachment ops a node was last built with
+    struct BuiltPass
+    {
+        std::vector<std::string>       outputTargetNames;
+        std::vector<std::string>       inputSampledImageNames;
+        std::vector<SamplerDefinition> inputSamplers;
+        std::vector<LoadOp>            loadOps;
+        std::vector<StoreOp>           storeOps;
+        PassType                       type       = PassType::GRAPHICS;
+        uint32_t                       renderPass = 0;
+        uint32_t                       subpass    = 0;
+    };
+
+    std::vector<PassHandle> m_execOrder;
     uint32_t m_windowWidth  = 0;
     uint32_t m_windowHeight = 0;
+
+    // dynamic resolution, see setGrowOnly( ) and setResolutionScale( )
+    bool     m_growOnly         = false;
+    uint32_t m_granularity      = 1;
+    float    m_resolutionScale  = 1.0f;
+    uint32_t m_imageWidth       = 0;
+    uint32_t m_imageHeight      = 0;
+    uint32_t m_renderableWidth  = 0;
+    uint32_t m_renderableHeight = 0;
+
+    // the resolved definitions given to generateImage( )/generateBuffer( )
+    std::map<std::string, ImageDefinition>  m_generatedImages;
+    std::map<std::string, BufferDefinition> m_generatedBuffers;
+    std::map<std::string, BuiltPass>        m_builtPasses;
+    ResizeStats                             m_stats;
+
+    // GPU time of each pass in m_execOrder, see getPassTimings( ).
+    // Each pass keeps its last m_timingWindow samples in a ring.
+    std::vector<PassTiming> m_passTimings;
+    std::vector<double>     m_timingSamples;
+    std::vector<uint64_t>   m_timingCount;
+    uint32_t                m_timingWindow = 64;
+
+    // see getFrameAllocations( )
+    mutable std::atomic<uint64_t> m_frameAllocations{0};
 };
 }
 
@@ -19,6 +19,18 @@ struct FrameGraphExecutor_OpenGL : public ExecutorBase
     {
         gl::GLuint              frameBuffer = 0;
         std::vector<gl::GLuint> inputAttachments;
+        std::vector<gl::GLuint> inputSamplers; // the sampler object of each input texture
+
+        // compute passes only. The storage images are the outputs
+        // followed by the storage inputs of the pass.
+        bool                    isCompute = false;
+        std::vector<gl::GLuint> storageImages;
+        std::vector<gl::GLenum> storageFormats;
+
+        // the buffers declared with inputBuffer( )/outputBuffer( )
+        // in the order they were declared
+        std::vector<gl::GLuint> inputBuffers;
+        std::vector<gl::GLuint> outputBuffers;
 
         void bindFramebuffer()
         {
@@ -30,6 +42,27 @@ struct FrameGraphExecutor_OpenGL : public ExecutorBase
             {
                 gl::glActiveTexture(gl::GL_TEXTURE0 + firstTextureIndex + i); // activate the texture unit first before binding texture
                 gl::glBindTexture(gl::GL_TEXTURE_2D, inputAttachments[i]);
+                gl::glBindSampler(firstTextureIndex + i, inputSamplers[i]);
+            }
+        }
+        void bindStorageImages(uint32_t firstImageUnit)
+        {
+            for(uint32_t i=0;i<storageImages.size();i++)
+            {
+                gl::glBindImageTexture(firstImageUnit + i, storageImages[i], 0, gl::GL_FALSE, 0, gl::GL_READ_WRITE, storageFormats[i]);
+            }
+        }
+        // binds the output buffers followed by the input
+        // buffers as shader storage buffers
+        void bindStorageBuffers(uint32_t firstBinding)
+        {
+            for(auto b : outputBuffers)
+            {
+                gl::glBindBufferBase(gl::GL_SHADER_STORAGE_BUFFER, firstBinding++, b);
+            }
+            for(auto b : inputBuffers)
+            {
+                gl::glBindBufferBase(gl::GL_SHADER_STORAGE_BUFFER, firstBinding++, b);
             }
         }
     };
@@ -47,6 +80,40 @@ struct FrameGraphExecutor_OpenGL : public ExecutorBase
         _renderers[renderPassName] = f;
     }
 
+    /**
+     * @brief importTexture
+     * @param targetName
+     * @param texture
+     *
+     * Use the application's texture for a target declared with
+     * FrameGraph::importTarget( ). The texture is never deleted by
+     * the executor. This must be called before resize( )
+     */
+    void importTexture(std::string const & targetName, gl::GLuint texture)
+    {
+        _imports[targetName] = texture;
+    }
+
+    /**
+     * @brief setProfiling
+     * @param enable
+     * @param latency
+     *
+     * Measure the GPU time of every pass, see getPassTimings( ). Each
+     * pass is bracketed with GL_TIMESTAMP queries, which are read back,
+     * without waiting, latency frames later. Frames whose queries are
+     * not available by then are not measured.
+     *
+     * This should be set before the first call to resize( )
+     */
+    void setProfiling(bool enable, uint32_t latency = 3)
+    {
+        assert(latency > 0);
+        m_profiling  = enable;
+        m_queryFrame = 0;
+        m_queryFrames.resize(latency);
+    }
+
     /**
      * @brief init
      * @param G
@@ -62,53 +129,328 @@ struct FrameGraphExecutor_OpenGL : public ExecutorBase
         for(auto & x : _nodes)
         {
             gl::glDeleteFramebuffers(1, &x.second.framebuffer);
-            x.second.framebuffer = 0;
+            gl::glDeleteFramebuffers(1, &x.second.resolveFramebuffer);
+            x.second.framebuffer        = 0;
+            x.second.resolveFramebuffer = 0;
         }
         for(auto & x : _imageNames)
         {
-            gl::glDeleteTextures(1, &x.second.textureID);
+            if(!x.second.imported)
+                gl::glDeleteTextures(1, &x.second.textureID);
+            if(x.second.mipViews.size())
+                gl::glDeleteTextures(static_cast<gl::GLsizei>(x.second.mipViews.size()), x.second.mipViews.data());
             x.second.textureID = 0;
         }
+        for(auto & x : _buffers)
+        {
+            gl::glDeleteBuffers(1, &x.second.bufferID);
+        }
+        for(auto & x : _samplers)
+        {
+            gl::glDeleteSamplers(1, &x.second);
+        }
+        _samplers.clear();
+        for(auto & Q : m_queryFrames)
+        {
+            if(Q.queries.size())
+                gl::glDeleteQueries(static_cast<gl::GLsizei>(Q.queries.size()), Q.queries.data());
+            Q = {};
+        }
         _imageNames.clear();
+        _buffers.clear();
         _nodes.clear();
+        m_plan.clear();
+        m_oddPlan.clear();
+        _resetGenerated();
     }
 
 
     void operator()(FrameGraph & G)
     {
-        for(auto & x : m_execOrder)
+        // history targets swap their images every frame
+        if(G.usesHistory())
+        {
+            std::swap(m_plan, m_oddPlan);
+        }
+        if(m_profiling)
+        {
+            _readTimestamps();
+        }
+
+        for(uint32_t i=0;i<m_plan.size();i++)
         {
-            auto & N = G.getNodes().at(x);
-            if( std::holds_alternative<RenderPassNode>(N))
+            // m_frame has enough capacity reserved for every pass
+            // so copying the prebuilt frame does not allocate.
+            auto & P = m_plan[i];
+            _copyFrame(m_frame, P.frame, &Frame::inputAttachments, &Frame::inputSamplers, &Frame::storageImages,
+                                         &Frame::storageFormats, &Frame::inputBuffers, &Frame::outputBuffers);
+            _writeTimestamp(2 * i);
+
+            // the resolution scale can change every frame
+            if(m_frame.resizable)
             {
-                auto &R = _renderers.at(x);
-                Frame F;
-                auto & node = _nodes.at(x);
-                F.frameBuffer      = node.framebuffer;
-                F.inputAttachments = node.inputAttachments;
-                F.imageWidth       = node.width;
-                F.imageHeight      = node.height;
-                F.renderableWidth  = node.width;
-                F.renderableHeight = node.height;
-
-                if(node.outputAttachments.size() == 0)
-                {
-                    F.imageWidth       = m_windowWidth;
-                    F.imageHeight      = m_windowHeight;
-                    F.renderableWidth  = m_windowWidth;
-                    F.renderableHeight = m_windowHeight;
-                    F.windowWidth      = m_windowWidth;
-                    F.windowHeight     = m_windowHeight;
-                }
-                R(F);
+                _renderableExtent(P.scale, m_frame.imageWidth, m_frame.imageHeight, m_frame.renderableWidth, m_frame.renderableHeight);
+            }
+            if(P.invalidateBefore.size())
+            {
+                gl::glInvalidateNamedFramebufferData(m_frame.frameBuffer, static_cast<gl::GLsizei>(P.invalidateBefore.size()), P.invalidateBefore.data());
+            }
+            (*P.renderer)(m_frame);
+
+            // resolve the multisampled attachments the
+            // passes after this one read
+            for(uint32_t k=0;k<P.resolveSource.size();k++)
+            {
+                auto w = static_cast<gl::GLint>(m_frame.renderableWidth);
+                auto h = static_cast<gl::GLint>(m_frame.renderableHeight);
+                gl::glNamedFramebufferReadBuffer(m_frame.frameBuffer, P.resolveSource[k]);
+                gl::glNamedFramebufferDrawBuffer(P.resolveFramebuffer, gl::GL_COLOR_ATTACHMENT0 + k);
+                gl::glBlitNamedFramebuffer(m_frame.frameBuffer, P.resolveFramebuffer, 0, 0, w, h, 0, 0, w, h, gl::GL_COLOR_BUFFER_BIT, gl::GL_NEAREST);
+            }
+            if(P.invalidateAfter.size())
+            {
+                gl::glInvalidateNamedFramebufferData(m_frame.frameBuffer, static_cast<gl::GLsizei>(P.invalidateAfter.size()), P.invalidateAfter.data());
             }
+
+            // make the storage image and buffer writes
+            // visible to the passes which read them
+            if(P.memoryBarrier != gl::MemoryBarrierMask{})
+            {
+                gl::glMemoryBarrier(P.memoryBarrier);
+            }
+            _writeTimestamp(2 * i + 1);
+        }
+
+        if(m_profiling)
+        {
+            m_queryFrame = (m_queryFrame + 1) % static_cast<uint32_t>(m_queryFrames.size());
+        }
+    }
+
+    /**
+     * @brief buildExecutionPlan
+     * @param G
+     *
+     * Resolves the renderer, framebuffer and extents of every pass,
+     * in execution order. If the graph has history targets, a second
+     * plan is built for odd frames and the two are swapped every frame.
+     */
+    void buildExecutionPlan(FrameGraph const & G)
+    {
+        m_oddPlan.clear();
+        if(G.usesHistory())
+        {
+            // operator() swaps the plans before the first frame
+            _buildPlan(G, 0);
+            std::swap(m_plan, m_oddPlan);
+            _buildPlan(G, 1);
         }
+        else
+        {
+            _buildPlan(G, 0);
+        }
+        _buildQueries();
     }
 
 
 
 protected:
 
+    // Gives every frame of the profiling latency a begin and an end
+    // timestamp query for each pass. Queries written with the previous
+    // plan are never read back.
+    void _buildQueries()
+    {
+        if(!m_profiling)
+            return;
+
+        auto queryCount = 2 * m_plan.size();
+        for(auto & Q : m_queryFrames)
+        {
+            Q.recorded = 0;
+            if(Q.queries.size() >= queryCount)
+                continue;
+            if(Q.queries.size())
+                gl::glDeleteQueries(static_cast<gl::GLsizei>(Q.queries.size()), Q.queries.data());
+            Q.queries.resize(queryCount);
+            gl::glGenQueries(static_cast<gl::GLsizei>(queryCount), Q.queries.data());
+        }
+    }
+
+    // Reads back the timestamps written latency frames ago, if the
+    // GPU has finished them. Nothing waits for the results.
+    void _readTimestamps()
+    {
+        auto & Q = m_queryFrames[m_queryFrame];
+        for(uint32_t i=0;i<Q.recorded;i++)
+        {
+            // the GPU finishes the queries in order
+            gl::GLint available = 0;
+            gl::glGetQueryObjectiv(Q.queries[2*i+1], gl::GL_QUERY_RESULT_AVAILABLE, &available);
+            if(!available)
+                break;
+
+            gl::GLuint64 begin = 0;
+            gl::GLuint64 end   = 0;
+            gl::glGetQueryObjectui64v(Q.queries[2*i],   gl::GL_QUERY_RESULT, &begin);
+            gl::glGetQueryObjectui64v(Q.queries[2*i+1], gl::GL_QUERY_RESULT, &end);
+            if(end >= begin)
+            {
+                _addTiming(i, static_cast<double>(end - begin) * 1e-6);
+            }
+        }
+        Q.recorded = static_cast<uint32_t>(m_plan.size());
+    }
+
+    void _writeTimestamp(uint32_t query)
+    {
+        if(m_profiling)
+        {
+            gl::glQueryCounter(m_queryFrames[m_queryFrame].queries[query], gl::GL_TIMESTAMP);
+        }
+    }
+
+    void _buildPlan(FrameGraph const & G, uint32_t parity)
+    {
+        auto & passes  = G.getPasses();
+        auto & targets = G.getTargets();
+        auto & buffers = G.getBuffers();
+        auto & bufferTable = G.getBufferTable();
+
+        m_plan.clear();
+        m_plan.reserve(m_execOrder.size());
+
+        size_t maxInputAttachments = 0;
+        size_t maxStorageImages    = 0;
+        size_t maxInputBuffers     = 0;
+        size_t maxOutputBuffers    = 0;
+        for(auto p : m_execOrder)
+        {
+            auto & name = passes.name[p.index];
+            auto & node = _nodes[_nodeName(G, p, parity)];
+            auto & P    = m_plan.emplace_back();
+            auto & F    = P.frame;
+
+            P.renderer         = &_renderers[name];
+            F.frameBuffer      = node.framebuffer;
+            F.inputAttachments = node.inputAttachments;
+            F.inputSamplers    = node.inputSamplers;
+            F.isCompute        = passes.type[p.index] == PassType::COMPUTE;
+            F.storageImages    = node.storageImages;
+            F.storageFormats   = node.storageFormats;
+            F.samples          = passes.samples[p.index];
+            P.resolveFramebuffer = node.resolveFramebuffer;
+            P.resolveSource      = node.resolveSource;
+            F.inputBuffers.clear();
+            F.outputBuffers.clear();
+            for(auto b : passes.getInputBuffers(p))
+            {
+                F.inputBuffers.push_back(_buffers.at(buffers[bufferTable.allocation[b.index].index].name).bufferID);
+            }
+            for(auto b : passes.getOutputBuffers(p))
+            {
+                F.outputBuffers.push_back(_buffers.at(buffers[bufferTable.allocation[b.index].index].name).bufferID);
+            }
+            F.imageWidth       = node.width;
+            F.imageHeight      = node.height;
+            F.renderableWidth  = node.width;
+            F.renderableHeight = node.height;
+            F.resizable        = _windowSized(G, p);
+            P.scale            = _windowScale(G, p);
+
+            if(node.outputAttachments.size() == 0 && !F.isCompute)
+            {
+                F.imageWidth       = m_windowWidth;
+                F.imageHeight      = m_windowHeight;
+                F.renderableWidth  = m_windowWidth;
+                F.renderableHeight = m_windowHeight;
+                F.windowWidth      = m_windowWidth;
+                F.windowHeight     = m_windowHeight;
+                F.resizable        = false;
+            }
+
+            // The attachments of the framebuffer whose contents are not
+            // needed before or after the pass. Resolves are attached to
+            // the resolve framebuffer instead.
+            P.invalidateBefore.clear();
+            P.invalidateAfter.clear();
+            if(!F.isCompute)
+            {
+                auto     outputs  = passes.getOutputs(p);
+                auto     loadOps  = passes.getOutputLoadOps(p);
+                auto     storeOps = passes.getOutputStoreOps(p);
+                uint32_t color    = 0;
+                for(uint32_t k=0;k<outputs.size();k++)
+                {
+                    auto t = outputs[k].index;
+                    if(targets.resolveSource[t].valid())
+                        continue;
+
+                    gl::GLenum attachment = gl::GL_DEPTH_ATTACHMENT;
+                    if(!isDepth(targets.format[t]))
+                        attachment = gl::GL_COLOR_ATTACHMENT0 + color++;
+
+                    if(loadOps[k] == LoadOp::DONT_CARE)
+                        P.invalidateBefore.push_back(attachment);
+                    if(storeOps[k] == StoreOp::DONT_CARE)
+                        P.invalidateAfter.push_back(attachment);
+                }
+            }
+
+            P.memoryBarrier = {};
+            if(F.isCompute)
+            {
+                P.memoryBarrier = P.memoryBarrier | gl::GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | gl::GL_TEXTURE_FETCH_BARRIER_BIT | gl::GL_FRAMEBUFFER_BARRIER_BIT;
+            }
+            if(F.outputBuffers.size())
+            {
+                P.memoryBarrier = P.memoryBarrier | gl::GL_SHADER_STORAGE_BARRIER_BIT | gl::GL_UNIFORM_BARRIER_BIT | gl::GL_COMMAND_BARRIER_BIT |
+                                                    gl::GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | gl::GL_ELEMENT_ARRAY_BARRIER_BIT;
+            }
+
+            maxInputAttachments = std::max(maxInputAttachments, F.inputAttachments.size());
+            maxStorageImages    = std::max(maxStorageImages, F.storageImages.size());
+            maxInputBuffers     = std::max(maxInputBuffers, F.inputBuffers.size());
+            maxOutputBuffers    = std::max(maxOutputBuffers, F.outputBuffers.size());
+        }
+        m_frame.inputAttachments.reserve(maxInputAttachments);
+        m_frame.inputSamplers.reserve(maxInputAttachments);
+        m_frame.storageImages.reserve(maxStorageImages);
+        m_frame.storageFormats.reserve(maxStorageImages);
+        m_frame.inputBuffers.reserve(maxInputBuffers);
+        m_frame.outputBuffers.reserve(maxOutputBuffers);
+    }
+
+    // Returns the sampler object for the definition, creating it the
+    // first time it is used. Sampler objects are shared by every texture
+    // and only deleted by destroy( )
+    gl::GLuint _getSampler(SamplerDefinition const & def)
+    {
+        auto & sampler = _samplers[def];
+        if(sampler != 0)
+            return sampler;
+
+        // inputs declared without a sampler are filtered
+        // linearly and clamped to the edge
+        gl::GLenum address = gl::GL_CLAMP_TO_EDGE;
+        switch(def.addressMode)
+        {
+            case SamplerAddressMode::MIRRORED_REPEAT: address = gl::GL_MIRRORED_REPEAT; break;
+            case SamplerAddressMode::REPEAT:          address = gl::GL_REPEAT; break;
+            case SamplerAddressMode::CLAMP_TO_BORDER: address = gl::GL_CLAMP_TO_BORDER; break;
+            default: break;
+        }
+        auto filter = def.filter == SamplerFilter::NEAREST ? gl::GL_NEAREST : gl::GL_LINEAR;
+
+        gl::glGenSamplers(1, &sampler);
+        gl::glSamplerParameteri(sampler, gl::GL_TEXTURE_MIN_FILTER, filter);
+        gl::glSamplerParameteri(sampler, gl::GL_TEXTURE_MAG_FILTER, filter);
+        gl::glSamplerParameteri(sampler, gl::GL_TEXTURE_WRAP_S, address);
+        gl::glSamplerParameteri(sampler, gl::GL_TEXTURE_WRAP_T, address);
+        gl::glSamplerParameteri(sampler, gl::GL_TEXTURE_WRAP_R, address);
+        return sampler;
+    }
+
     static gl::GLenum _getInternalFormatFromDef(FrameGraphFormat format)
     {
         switch(format)
@@ -296,17 +638,13 @@ protected:
         }
     }
 
-    static gl::GLuint _createFramebufferTexture(FrameGraphFormat format, uint32_t width, uint32_t height)
+    static gl::GLuint _createFramebufferTexture(FrameGraphFormat format, uint32_t width, uint32_t height, uint32_t samples = 1)
     {
-        bool multisampled=false;
+        bool multisampled = samples > 1;
         gl::GLuint outID;
 
         auto textureTarget = multisampled ? gl::GL_TEXTURE_2D_MULTISAMPLE : gl::GL_TEXTURE_2D;
 
-        int  samples = 1;
-        //auto width   = def.width;
-        //auto height  = def.height;
-
         gl::glCreateTextures( textureTarget, 1, &outID);
         gl::glBindTexture(textureTarget, outID);
         if (multisampled)
@@ -314,8 +652,8 @@ protected:
             auto internalFormat = _getInternalFormatFromDef(format);
 
             GFG_INFO("Image Created: {}x{}", width, height);
-            glTexImage2DMultisample(gl::GL_TEXTURE_2D_MULTISAMPLE,
-                                    samples,
+            gl::glTexImage2DMultisample(gl::GL_TEXTURE_2D_MULTISAMPLE,
+                                    static_cast<gl::GLsizei>(samples),
                                     internalFormat,
                                     static_cast<gl::GLsizei>(width),
                                     static_cast<gl::GLsizei>(height),
@@ -335,29 +673,84 @@ protected:
                              glFormat,
                              gl::GL_UNSIGNED_BYTE,
                              nullptr);
-
-            gl::glTexParameteri(gl::GL_TEXTURE_2D, gl::GL_TEXTURE_MIN_FILTER, gl::GL_LINEAR);
-            gl::glTexParameteri(gl::GL_TEXTURE_2D, gl::GL_TEXTURE_MAG_FILTER, gl::GL_LINEAR);
-            gl::glTexParameteri(gl::GL_TEXTURE_2D, gl::GL_TEXTURE_WRAP_R, gl::GL_CLAMP_TO_EDGE);
-            gl::glTexParameteri(gl::GL_TEXTURE_2D, gl::GL_TEXTURE_WRAP_S, gl::GL_CLAMP_TO_EDGE);
-            gl::glTexParameteri(gl::GL_TEXTURE_2D, gl::GL_TEXTURE_WRAP_T, gl::GL_CLAMP_TO_EDGE);
         }
         gl::glBindTexture(textureTarget, 0);
         return outID;
     }
 
+    // Creates a texture with immutable storage for all the mip levels
+    // and a texture view of each level, so a level can be rendered to,
+    // sampled or bound as a storage image on its own.
+    static gl::GLuint _createMipChainTexture(FrameGraphFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, std::vector<gl::GLuint> & mipViews)
+    {
+        auto internalFormat = _getInternalFormatFromDef(format);
+
+        gl::GLuint outID;
+        gl::glCreateTextures(gl::GL_TEXTURE_2D, 1, &outID);
+        gl::glTextureStorage2D(outID,
+                               static_cast<gl::GLsizei>(mipLevels),
+                               internalFormat,
+                               static_cast<gl::GLsizei>(width),
+                               static_cast<gl::GLsizei>(height));
+
+        mipViews.resize(mipLevels);
+        gl::glGenTextures(static_cast<gl::GLsizei>(mipLevels), mipViews.data());
+        for(uint32_t i=0;i<mipLevels;i++)
+        {
+            gl::glTextureView(mipViews[i], gl::GL_TEXTURE_2D, outID, internalFormat, i, 1, 0, 1);
+        }
+        GFG_INFO("Image Created: {}x{} with {} mip levels", width, height, mipLevels);
+        return outID;
+    }
+
+    // The texture of a name given by resize( ) and its extent. Images
+    // with more than one mip level are only used one level at a time.
+    gl::GLuint _texture(std::string const & name, uint32_t & width, uint32_t & height) const
+    {
+        uint32_t mip = 0;
+        auto &   img = _imageNames.at(_splitMipName(name, mip));
+        width  = std::max(img.width  >> mip, 1u);
+        height = std::max(img.height >> mip, 1u);
+        return img.mipViews.empty() ? img.textureID : img.mipViews[mip];
+    }
+    gl::GLuint _texture(std::string const & name) const
+    {
+        uint32_t width, height;
+        return _texture(name, width, height);
+    }
+
 
     // ExecutorBase interface
 public:
-    void generateImage(const std::string &imageName, FrameGraphFormat format, uint32_t width, uint32_t height)
+    void generateImage(ImageDefinition const & imageDef)
     {
+        auto & imageName = imageDef.name;
+        auto   format    = imageDef.format;
+        auto   width     = imageDef.width;
+        auto   height    = imageDef.height;
+
+
         if(_imageNames.count(imageName) != 0)
             return;
 
-        _imageNames[imageName].textureID = _createFramebufferTexture(format, width, height);
+        if(imageDef.imported)
+        {
+            assert(_imports.count(imageName) != 0);
+            _imageNames[imageName].textureID = _imports.at(imageName);
+            _imageNames[imageName].imported  = true;
+        }
+        else if(imageDef.mipLevels > 1)
+        {
+            _imageNames[imageName].textureID = _createMipChainTexture(format, width, height, imageDef.mipLevels, _imageNames[imageName].mipViews);
+        }
+        else
+        {
+            _imageNames[imageName].textureID = _createFramebufferTexture(format, width, height, imageDef.samples);
+        }
         _imageNames[imageName].width     = width;
         _imageNames[imageName].height    = height;
         _imageNames[imageName].format    = format;
+        _imageNames[imageName].samples   = imageDef.samples;
     }
     void destroyImage(const std::string &imageName)
     {
@@ -365,7 +758,11 @@ public:
             return;
 
         auto & img = _imageNames.at(imageName);
-        if(img.textureID)
+        if(img.mipViews.size())
+        {
+            gl::glDeleteTextures(static_cast<gl::GLsizei>(img.mipViews.size()), img.mipViews.data());
+        }
+        if(img.textureID && !img.imported)
         {
             gl::glDeleteTextures(1, &img.textureID);
             img.textureID = 0;
@@ -373,7 +770,31 @@ public:
         }
         _imageNames.erase(imageName);
     }
-    void buildFrameBuffer(const std::string &renderPassName, const std::vector<std::string> &outputTargetImages, const std::vector<std::string> &inputSampledImages)
+    void postImageGeneration(std::vector<ImageDefinition> const &)
+    {
+
+    }
+    void generateBuffer(BufferDefinition const & bufferDef)
+    {
+        if(_buffers.count(bufferDef.name) != 0)
+            return;
+
+        auto & buf = _buffers[bufferDef.name];
+        gl::glCreateBuffers(1, &buf.bufferID);
+        gl::glNamedBufferStorage(buf.bufferID, static_cast<gl::GLsizeiptr>(bufferDef.size), nullptr, gl::GL_DYNAMIC_STORAGE_BIT);
+        buf.size = bufferDef.size;
+        GFG_INFO("Buffer Created: {}   {} bytes", bufferDef.name, bufferDef.size);
+    }
+    void destroyBuffer(const std::string &bufferName)
+    {
+        if(_buffers.count(bufferName) == 0)
+            return;
+
+        gl::glDeleteBuffers(1, &_buffers.at(bufferName).bufferID);
+        _buffers.erase(bufferName);
+        GFG_INFO("Buffer Deleted: {}", bufferName);
+    }
+    void buildFrameBuffer(const std::string &renderPassName, const std::vector<std::string> &outputTargetImages, const std::vector<std::string> &inputSampledImages, const std::vector<SamplerDefinition> &inputSamplers)
     {
         auto & _glNode = _nodes[renderPassName];
         if(outputTargetImages.size() == 0)
@@ -391,23 +812,39 @@ public:
         uint32_t i = 0;
 
         _glNode.outputAttachments.clear();
+        _glNode.inputAttachments.clear();
+        _glNode.inputSamplers.clear();
+        _glNode.resolveSource.clear();
+
+        // the single sampled outputs of a multisampled pass are
+        // resolves. They are attached to a second framebuffer which
+        // the color attachment before them is blitted to.
+        std::vector<gl::GLuint> resolveTextures;
+        bool multisampled = false;
         for (auto imgName : outputTargetImages)
         {
             //auto &RTN = std::get<RenderTargetNode>(G.getNodes().at(r.name));
             //auto  imgName = RTN.imageResource.name;
-            auto &imgDef  =  _imageNames.at(imgName);
-            auto  imgID   = _imageNames.at(imgName).textureID;
+            uint32_t mip = 0;
+            auto &imgDef  =  _imageNames.at(_splitMipName(imgName, mip));
+            auto  imgID   = _texture(imgName, _glNode.width, _glNode.height);
 
+            if(multisampled && imgDef.samples == 1)
+            {
+                resolveTextures.push_back(imgID);
+                _glNode.resolveSource.push_back(gl::GL_COLOR_ATTACHMENT0 + (i - 1));
+                continue;
+            }
+            multisampled |= imgDef.samples > 1;
 
-            _glNode.width  = imgDef.width;
-            _glNode.height = imgDef.height;
-            gl::glBindTexture(gl::GL_TEXTURE_2D, imgID);
+            auto textureTarget = imgDef.samples > 1 ? gl::GL_TEXTURE_2D_MULTISAMPLE : gl::GL_TEXTURE_2D;
+            gl::glBindTexture(textureTarget, imgID);
 
             if( isDepth(imgDef.format) )
             {
                 gl::glFramebufferTexture2D( gl::GL_FRAMEBUFFER,
                                             gl::GL_DEPTH_ATTACHMENT,
-                                            gl::GL_TEXTURE_2D,
+                                            textureTarget,
                                             imgID,
                                             0);
             }
@@ -415,7 +852,7 @@ public:
             {
                 gl::glFramebufferTexture2D( gl::GL_FRAMEBUFFER,
                                             gl::GL_COLOR_ATTACHMENT0 + i,
-                                            gl::GL_TEXTURE_2D,
+                                            textureTarget,
                                             imgID, 0);
                 ++i;
 
@@ -429,11 +866,20 @@ public:
             GFG_ERROR("Framebuffer for, {}, is not complete!", renderPassName);
         }
 
-        for(auto imgName : inputSampledImages)
+        if(resolveTextures.size() && _glNode.resolveFramebuffer == 0)
         {
-            auto &imgDef = _imageNames.at(imgName);
-            auto  imgID  = _imageNames.at(imgName).textureID;
+            gl::glCreateFramebuffers(1, &_glNode.resolveFramebuffer);
+        }
+        for(uint32_t k=0;k<resolveTextures.size();k++)
+        {
+            gl::glNamedFramebufferTexture(_glNode.resolveFramebuffer, gl::GL_COLOR_ATTACHMENT0 + k, resolveTextures[k], 0);
+        }
+
+        for(size_t k=0;k<inputSampledImages.size();k++)
+        {
+            auto imgID = _texture(inputSampledImages[k]);
             _glNode.inputAttachments.push_back(imgID);
+            _glNode.inputSamplers.push_back(_getSampler(inputSamplers[k]));
         }
 
         _glNode.isInit = true;
@@ -441,9 +887,46 @@ public:
 
     }
 
+    void buildComputePass(const std::string &computePassName, const std::vector<std::string> &storageImages, const std::vector<std::string> &inputSampledImages, const std::vector<SamplerDefinition> &inputSamplers)
+    {
+        auto & _glNode = _nodes[computePassName];
+
+        _glNode.storageImages.clear();
+        _glNode.storageFormats.clear();
+        _glNode.inputAttachments.clear();
+        _glNode.inputSamplers.clear();
+        for(auto & imgName : storageImages)
+        {
+            uint32_t mip = 0;
+            auto & img = _imageNames.at(_splitMipName(imgName, mip));
+            _glNode.storageImages.push_back(_texture(imgName));
+            _glNode.storageFormats.push_back(_getInternalFormatFromDef(img.format));
+        }
+        if(storageImages.size())
+        {
+            _texture(storageImages.front(), _glNode.width, _glNode.height);
+        }
+        for(size_t k=0;k<inputSampledImages.size();k++)
+        {
+            _glNode.inputAttachments.push_back(_texture(inputSampledImages[k]));
+            _glNode.inputSamplers.push_back(_getSampler(inputSamplers[k]));
+        }
+        _glNode.isInit = true;
+    }
+
     void destroyFrameBuffer(const std::string &renderPassName)
     {
 
+    }
+    void destroyPass(const std::string &passName)
+    {
+        auto it = _nodes.find(passName);
+        if(it == _nodes.end())
+            return;
+
+        gl::glDeleteFramebuffers(1, &it->second.framebuffer);
+        gl::glDeleteFramebuffers(1, &it->second.resolveFramebuffer);
+        _nodes.erase(it);
     }
     void preResize()
     {
@@ -458,22 +941,72 @@ public:
         bool                    isInit      = false;
         gl::GLuint              framebuffer = 0;
         std::vector<gl::GLuint> inputAttachments;
+        std::vector<gl::GLuint> inputSamplers;
         std::vector<gl::GLuint> outputAttachments;
+        std::vector<gl::GLuint> storageImages;
+
+        // the color attachment of framebuffer which is blitted to each
+        // color attachment of resolveFramebuffer after the pass
+        gl::GLuint              resolveFramebuffer = 0;
+        std::vector<gl::GLenum> resolveSource;
+        std::vector<gl::GLenum> storageFormats;
         uint32_t                width  = 0;
         uint32_t                height = 0;
     };
 
+    // Everything operator() needs to execute a single pass.
+    struct PassRecord {
+        std::function<void(Frame &)> * renderer = nullptr;
+        Frame                          frame;
+        gl::MemoryBarrierMask          memoryBarrier = {}; // issued after the pass
+        float                          scale         = 1.0f; // of the window, if frame.resizable
+
+        // the multisampled attachments resolved after the pass, see GLNodeInfo
+        gl::GLuint                     resolveFramebuffer = 0;
+        std::vector<gl::GLenum>        resolveSource;
+
+        // attachments which are not loaded/stored, see PassTable::outputLoadOp
+        std::vector<gl::GLenum>        invalidateBefore;
+        std::vector<gl::GLenum>        invalidateAfter;
+    };
+
     struct GLImageInfo {
         gl::GLuint textureID = 0;
         uint32_t   width     = 0;
         uint32_t   height    = 0;
         bool       resizable = true;
+        bool       imported  = false; // owned by the application
+        uint32_t   samples   = 1;
         FrameGraphFormat format;
+
+        // a view of each mip level, if the image has more than one
+        std::vector<gl::GLuint> mipViews;
+    };
+
+    struct GLBufferInfo {
+        gl::GLuint bufferID = 0;
+        uint64_t   size     = 0;
     };
 
     std::map<std::string, GLNodeInfo>                   _nodes;
     std::map<std::string, GLImageInfo>                  _imageNames;
+    std::map<std::string, GLBufferInfo>                 _buffers;
     std::map<std::string, std::function<void(Frame &)>> _renderers;
+    std::map<std::string, gl::GLuint>                   _imports;
+    std::map<SamplerDefinition, gl::GLuint>             _samplers; // shared by all the textures
+    std::vector<PassRecord>                             m_plan;
+    std::vector<PassRecord>                             m_oddPlan; // swapped with m_plan every frame when the graph uses history
+    Frame                                               m_frame; // reused for every pass
+
+    // timestamp queries of the frames in flight, see setProfiling( )
+    struct QueryFrame
+    {
+        std::vector<gl::GLuint> queries;      // the begin and end of each pass
+        uint32_t                recorded = 0; // the number of passes whose timestamps were written
+    };
+    bool                                                m_profiling  = false;
+    uint32_t                                            m_queryFrame = 0; // written this frame
+    std::vector<QueryFrame>                             m_queryFrames = std::vector<QueryFrame>(3);
 };
 }
 
@@ -9,6 +9,7 @@
 #include <unordered_set>
 #include "../frameGraph.h"
 #include "ExecutorBase.h"
+#include "WorkerPool.h"
 #include <vulkan/vulkan.h>
 
 #include <vk_mem_alloc.h>
@@ -17,37 +18,65 @@ namespace gfg
 {
 struct FrameBuffer
 {
-    std::vector<VkImageView> attachments;
-    uint32_t                 imgWidth;
-    uint32_t                 imgHeight;
+    std::vector<VkImageView>       attachments;
+    std::vector<VkImageUsageFlags> attachmentUsage; // the usage the attachment images were created with
+    uint32_t                       imgWidth;
+    uint32_t                       imgHeight;
+
+    // Owned by the executor's caches and shared by every
+    // node with the same signature, see renderPassKey( )
     VkRenderPass             renderPass = VK_NULL_HANDLE;
     VkFramebuffer            frameBuffer = VK_NULL_HANDLE;
 
+    // chained to the render pass begin info when the
+    // framebuffer is imageless, points at attachments
+    VkRenderPassAttachmentBeginInfo attachmentBeginInfo = {};
+
     std::vector<VkAttachmentDescription> m_attachmentDesc;
 
-    void insertColorImage(VkImageView v, VkFormat format)
+    // When the render pass is made of merged passes, each subpass
+    // lists the attachments it uses. If this is empty, a single
+    // subpass renders to all the attachments.
+    struct Subpass
+    {
+        std::vector<uint32_t> colorAttachments;
+        std::vector<uint32_t> resolveAttachments; // one per color attachment, or empty
+        int32_t               depthAttachment = -1;
+        std::vector<uint32_t> inputAttachments;
+        std::vector<uint32_t> preserveAttachments;
+    };
+    std::vector<Subpass>             m_subpasses;
+    std::vector<VkSubpassDependency> m_dependencies;
+
+    void insertColorImage(VkImageView v, VkFormat format, VkImageUsageFlags usage, VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT)
     {
         auto & a = m_attachmentDesc.emplace_back();
 
-        a.samples        = VK_SAMPLE_COUNT_1_BIT;
+        // the load/store ops are replaced by the ones
+        // the graph derived, see _setAttachmentOps( )
+        a.samples        = samples;
         a.loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
         a.storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
         a.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         a.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         a.format         = static_cast<VkFormat>(format);
 
+        // The executor transitions the image into the attachment
+        // layout before the render pass begins and out of it
+        // when it is read, so the render pass does not change it.
         if ( isDepth( static_cast<FrameGraphFormat>(format) ) )
         {
-            a.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            a.finalLayout   = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            a.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+            a.finalLayout   = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
         }
         else
         {
-            a.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            a.finalLayout   = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            a.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            a.finalLayout   = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
         }
 
         attachments.push_back(v);
+        attachmentUsage.push_back(usage);
     }
 
     void setExtents(uint32_t width, uint32_t height)
@@ -56,7 +85,47 @@ struct FrameBuffer
         imgHeight = height;
     }
 
-    void createFramebuffer(VkDevice device)
+    /**
+     * Everything the VkRenderPass is created from: the attachment
+     * formats, load/store ops and layouts, the subpasses and their
+     * dependencies. Render passes with the same key are identical.
+     */
+    std::vector<uint32_t> renderPassKey() const
+    {
+        std::vector<uint32_t> key;
+        key.push_back(static_cast<uint32_t>(m_attachmentDesc.size()));
+        for(auto & a : m_attachmentDesc)
+        {
+            key.insert(key.end(), { static_cast<uint32_t>(a.format), static_cast<uint32_t>(a.samples),
+                                    static_cast<uint32_t>(a.loadOp), static_cast<uint32_t>(a.storeOp),
+                                    static_cast<uint32_t>(a.stencilLoadOp), static_cast<uint32_t>(a.stencilStoreOp),
+                                    static_cast<uint32_t>(a.initialLayout), static_cast<uint32_t>(a.finalLayout) });
+        }
+        key.push_back(static_cast<uint32_t>(m_subpasses.size()));
+        for(auto & S : m_subpasses)
+        {
+            key.push_back(static_cast<uint32_t>(S.depthAttachment));
+            for(auto * list : {&S.colorAttachments, &S.resolveAttachments, &S.inputAttachments, &S.preserveAttachments})
+            {
+                key.push_back(static_cast<uint32_t>(list->size()));
+                key.insert(key.end(), list->begin(), list->end());
+            }
+        }
+        key.push_back(static_cast<uint32_t>(m_dependencies.size()));
+        for(auto & d : m_dependencies)
+        {
+            key.insert(key.end(), { d.srcSubpass, d.dstSubpass, d.srcStageMask, d.dstStageMask,
+                                    d.srcAccessMask, d.dstAccessMask, d.dependencyFlags });
+        }
+        return key;
+    }
+
+    /**
+     * Creates the framebuffer for renderPass. An imageless framebuffer
+     * only depends on the extent, usage and format of the attachments,
+     * the views are given when the render pass begins.
+     */
+    void createFramebuffer(VkDevice device, bool imageless)
     {
         assert( frameBuffer == VK_NULL_HANDLE);
         VkFramebufferCreateInfo fbufCreateInfo = {};
@@ -69,6 +138,30 @@ struct FrameBuffer
         fbufCreateInfo.height          = imgHeight;
         fbufCreateInfo.layers          = 1;
 
+        std::vector<VkFramebufferAttachmentImageInfo> imageInfo(attachments.size());
+        VkFramebufferAttachmentsCreateInfo            attachmentsInfo = {};
+        if(imageless)
+        {
+            for(size_t i=0;i<attachments.size();i++)
+            {
+                auto & ii = imageInfo[i];
+                ii.sType           = VK_STRUCTURE_TYPE_FRAMEBUFFER_ATTACHMENT_IMAGE_INFO;
+                ii.usage           = attachmentUsage[i];
+                ii.width           = imgWidth;
+                ii.height          = imgHeight;
+                ii.layerCount      = 1;
+                ii.viewFormatCount = 1;
+                ii.pViewFormats    = &m_attachmentDesc[i].format;
+            }
+            attachmentsInfo.sType                    = VK_STRUCTURE_TYPE_FRAMEBUFFER_ATTACHMENTS_CREATE_INFO;
+            attachmentsInfo.attachmentImageInfoCount = static_cast<uint32_t>(imageInfo.size());
+            attachmentsInfo.pAttachmentImageInfos    = imageInfo.data();
+
+            fbufCreateInfo.pNext        = &attachmentsInfo;
+            fbufCreateInfo.flags        = VK_FRAMEBUFFER_CREATE_IMAGELESS_BIT;
+            fbufCreateInfo.pAttachments = nullptr;
+        }
+
         {
             auto res = vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffer);
             if (res != VK_SUCCESS)
@@ -87,66 +180,85 @@ struct FrameBuffer
             return;
         }
 
-        std::vector<VkAttachmentReference> colorReferences;
-        VkAttachmentReference depthReference = {};
-        depthReference.attachment = 0;
-        depthReference.layout     = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-        // Init attachment properties
-        bool has_depth = false;
+        // a single subpass which renders to all the attachments. A single
+        // sampled attachment after a multisampled one is its resolve.
+        auto subpasses = m_subpasses;
+        if(subpasses.empty())
         {
-            uint32_t i=0;
-            for(auto & a : m_attachmentDesc)
+            auto & S = subpasses.emplace_back();
+            for(uint32_t i=0;i<m_attachmentDesc.size();i++)
             {
-                if( !isDepth( static_cast<FrameGraphFormat>(a.format) ))
+                if( isDepth( static_cast<FrameGraphFormat>(m_attachmentDesc[i].format) ))
+                {
+                    S.depthAttachment = static_cast<int32_t>(i);
+                }
+                else if( i > 0 && m_attachmentDesc[i].samples == VK_SAMPLE_COUNT_1_BIT && m_attachmentDesc[i-1].samples != VK_SAMPLE_COUNT_1_BIT )
                 {
-                    colorReferences.push_back({ i, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+                    S.resolveAttachments.resize(S.colorAttachments.size(), VK_ATTACHMENT_UNUSED);
+                    S.resolveAttachments.back() = i;
                 }
                 else
                 {
-                    depthReference.attachment = i;
-                    has_depth = true;
+                    S.colorAttachments.push_back(i);
                 }
-                i++;
             }
+            if(!S.resolveAttachments.empty())
+                S.resolveAttachments.resize(S.colorAttachments.size(), VK_ATTACHMENT_UNUSED);
         }
 
-        VkSubpassDescription subpass = {};
-        subpass.pipelineBindPoint    = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.pColorAttachments    = colorReferences.data();
-        subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+        // the references need to stay alive until the render pass is created
+        std::vector<std::vector<VkAttachmentReference>> colorReferences(subpasses.size());
+        std::vector<std::vector<VkAttachmentReference>> resolveReferences(subpasses.size());
+        std::vector<std::vector<VkAttachmentReference>> inputReferences(subpasses.size());
+        std::vector<VkAttachmentReference>              depthReferences(subpasses.size());
+        std::vector<VkSubpassDescription>               subpassDesc(subpasses.size());
 
-        if( has_depth )
+        for(size_t k=0;k<subpasses.size();k++)
         {
-            subpass.pDepthStencilAttachment = &depthReference;
-        }
-
-        std::array<VkSubpassDependency, 2> dependencies;
-
-        dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
-        dependencies[0].dstSubpass      = 0;
-        dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-        dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependencies[0].srcAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
-        dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-        dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+            auto & S = subpasses[k];
+            for(auto i : S.colorAttachments)
+            {
+                colorReferences[k].push_back({ i, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+            }
+            for(auto i : S.resolveAttachments)
+            {
+                resolveReferences[k].push_back({ i, i == VK_ATTACHMENT_UNUSED ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+            }
+            for(auto i : S.inputAttachments)
+            {
+                auto layout = isDepth( static_cast<FrameGraphFormat>(m_attachmentDesc[i].format) ) ?
+                                  VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                inputReferences[k].push_back({ i, layout });
+            }
 
-        dependencies[1].srcSubpass      = 0;
-        dependencies[1].dstSubpass      = VK_SUBPASS_EXTERNAL;
-        dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-        dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-        dependencies[1].dstAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
-        dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+            auto & subpass = subpassDesc[k];
+            subpass.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+            subpass.pColorAttachments       = colorReferences[k].data();
+            subpass.colorAttachmentCount    = static_cast<uint32_t>(colorReferences[k].size());
+            subpass.pResolveAttachments     = resolveReferences[k].empty() ? nullptr : resolveReferences[k].data();
+            subpass.pInputAttachments       = inputReferences[k].data();
+            subpass.inputAttachmentCount    = static_cast<uint32_t>(inputReferences[k].size());
+            subpass.pPreserveAttachments    = S.preserveAttachments.data();
+            subpass.preserveAttachmentCount = static_cast<uint32_t>(S.preserveAttachments.size());
+
+            if( S.depthAttachment >= 0 )
+            {
+                depthReferences[k] = { static_cast<uint32_t>(S.depthAttachment), VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+                subpass.pDepthStencilAttachment = &depthReferences[k];
+            }
+        }
 
+        // No external dependencies are needed, the executor records
+        // image barriers between the passes which need them. Only the
+        // dependencies between subpasses are given.
         VkRenderPassCreateInfo renderPassInfo = {};
         renderPassInfo.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
         renderPassInfo.pAttachments    = m_attachmentDesc.data();
         renderPassInfo.attachmentCount = static_cast<uint32_t>(m_attachmentDesc.size());
-        renderPassInfo.subpassCount    = 1;
-        renderPassInfo.pSubpasses      = &subpass;
-        renderPassInfo.dependencyCount = 2;
-        renderPassInfo.pDependencies   = dependencies.data();
+        renderPassInfo.subpassCount    = static_cast<uint32_t>(subpassDesc.size());
+        renderPassInfo.pSubpasses      = subpassDesc.data();
+        renderPassInfo.dependencyCount = static_cast<uint32_t>(m_dependencies.size());
+        renderPassInfo.pDependencies   = m_dependencies.data();
 
         renderPass = VK_NULL_HANDLE;
         {
@@ -187,9 +299,12 @@ struct FrameGraphExecutor_Vulkan : public ExecutorBase
     struct Frame : public FrameBase {
         VkCommandBuffer          commandBuffer;
         VkFramebuffer            frameBuffer;
-        VkRenderPass             renderPass;
+        VkRenderPass             renderPass; // the same across resizes if the attachments do not change
         std::vector<VkImageView> inputAttachments;
 
+        // the attachment views when the framebuffer is imageless
+        VkRenderPassAttachmentBeginInfo const * attachmentBeginInfo = nullptr;
+
         // The input attachment set is a descriptor set that should look like this in the shader:
         // layout (set = X, binding = 0) uniform sampler2D u_Attachment[maxInputTextures];
         // it will contain any input textures that should be read from.
@@ -204,10 +319,55 @@ struct FrameGraphExecutor_Vulkan : public ExecutorBase
         // this will be set to some default values for you
         std::vector<VkClearValue> clearValue;
 
+        // The subpass this pass renders in. Passes merged into the same
+        // render pass are executed as consecutive subpasses, beginRenderPass( )
+        // moves to the next subpass and endRenderPass( ) only ends the render
+        // pass in the last subpass. Create pipelines with this subpass index.
+        uint32_t                 subpass     = 0;
+        bool                     lastSubpass = true;
+
+        // The input attachment set for targets read with inputAttachment( ) which
+        // are written in the same render pass. It should look like this in the shader:
+        // layout (input_attachment_index = 0, set = X, binding = 0) uniform subpassInput u_Input[maxInputTextures];
+        // if this is VK_NULL_HANDLE the pass has no subpass inputs
+        VkDescriptorSet          subpassInputSet       = VK_NULL_HANDLE;
+        VkDescriptorSetLayout    subpassInputSetLayout = VK_NULL_HANDLE;
+
+        // Compute passes are recorded outside of a render pass so
+        // beginRenderPass( )/endRenderPass( ) do nothing. The images the pass
+        // writes are in the storage image set, in the GENERAL layout:
+        // layout (set = X, binding = 0, rgba8) uniform image2D u_Output[maxInputTextures];
+        bool                     isCompute             = false;
+        VkDescriptorSet          storageImageSet       = VK_NULL_HANDLE;
+        VkDescriptorSetLayout    storageImageSetLayout = VK_NULL_HANDLE;
+
+        // the buffers declared with inputBuffer( )/outputBuffer( ), in the
+        // order they were declared. The executor records the barriers
+        // between the passes which write and read them.
+        std::vector<VkBuffer>    inputBuffers;
+        std::vector<VkBuffer>    outputBuffers;
+
+        // When parallel recording is enabled, commandBuffer is a secondary
+        // command buffer which is already inside the render pass. The
+        // render pass is begun and ended by the executor, so
+        // beginRenderPass( )/endRenderPass( ) do nothing.
+        bool                                   isSecondary     = false;
+        VkCommandBufferInheritanceInfo const * inheritanceInfo = nullptr;
+
         void beginRenderPass()
         {
+            if(isSecondary || isCompute)
+                return;
+
+            if(subpass > 0)
+            {
+                vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+                return;
+            }
+
             VkRenderPassBeginInfo render_pass_info = {};
             render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            render_pass_info.pNext             = attachmentBeginInfo;
             render_pass_info.renderPass        = renderPass;
             render_pass_info.framebuffer       = frameBuffer;
             render_pass_info.renderArea.offset = {0, 0};
@@ -222,9 +382,14 @@ struct FrameGraphExecutor_Vulkan : public ExecutorBase
 
         void endRenderPass()
         {
+            if(isSecondary || isCompute || !lastSubpass)
+                return;
             vkCmdEndRenderPass(commandBuffer);
         }
 
+        // The executor records the barriers needed between passes,
+        // this is only useful if the renderer accesses resources
+        // which are not part of the graph.
         void fullBarrier()
         {
             vkCmdPipelineBarrier(commandBuffer,
@@ -253,12 +418,34 @@ struct FrameGraphExecutor_Vulkan : public ExecutorBase
         VkRenderPass    swapchainRenderPass; // the renderpass that the swapchain will be using
     };
 
+    /**
+     * @brief The TimelineSubmitInfo struct
+     *
+     * When async compute is enabled, the submit of
+     * RenderInfo::commandBuffer must wait for and signal these
+     * timeline semaphore values. A null waitSemaphore means there
+     * is nothing to wait for.
+     */
+    struct TimelineSubmitInfo
+    {
+        VkSemaphore          waitSemaphore   = VK_NULL_HANDLE;
+        uint64_t             waitValue       = 0;
+        VkPipelineStageFlags waitStage       = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkSemaphore          signalSemaphore = VK_NULL_HANDLE;
+        uint64_t             signalValue     = 0;
+    };
 
 
     void init(VmaAllocator allocator, VkDevice device)
     {
         m_allocator = allocator;
         m_device = device;
+
+        // tile based GPUs can leave transient attachments unbacked
+        VmaAllocationCreateInfo lazyInfo = {};
+        lazyInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+        uint32_t memoryTypeIndex = 0;
+        m_lazilyAllocatedMemory = vmaFindMemoryTypeIndex(m_allocator, UINT32_MAX, &lazyInfo, &memoryTypeIndex) == VK_SUCCESS;
     }
 
     void destroy()
@@ -276,20 +463,68 @@ struct FrameGraphExecutor_Vulkan : public ExecutorBase
         for(auto &  n : nodesToDestroy)
         {
             auto & N = _nodes.at(n);
-            vkDestroyDescriptorPool(m_device, N.descriptorPool, nullptr);
-            N.descriptorSet = {};
+            N.descriptorSet.clear();
+            N.subpassInputSet.clear();
+            N.storageImageSet.clear();
             destroyFrameBuffer(n);
-            if(N.m_frameBuffer.renderPass)
-                N.m_frameBuffer.destroyRenderPass(m_device);
+            N.m_frameBuffer.renderPass = VK_NULL_HANDLE;
+        }
+        for(auto & R : m_renderPasses)
+        {
+            vkDestroyRenderPass(m_device, R.second, nullptr);
+        }
+        for(auto & F : m_framebuffers)
+        {
+            vkDestroyFramebuffer(m_device, F.second.frameBuffer, nullptr);
         }
+        m_renderPasses.clear();
+        m_framebuffers.clear();
         for(auto & i : imagesToDestroy)
         {
             destroyImage(i);
         }
+        for(auto & b : _buffers)
+        {
+            vmaDestroyBuffer(m_allocator, b.second.buffer, b.second.allocation);
+        }
+        _buffers.clear();
+        for(auto & S : _samplers)
+        {
+            vkDestroySampler(m_device, S.second, nullptr);
+        }
+        _samplers.clear();
+        m_transientHeaps.clear();
+        for(auto & Q : m_queryFrames)
+        {
+            vkDestroyQueryPool(m_device, Q.pool, nullptr);
+        }
+        m_queryFrames.clear();
+        m_queryCapacity = 0;
+        setParallelRecording(0, 0);
+        setAsyncCompute(VK_NULL_HANDLE, 0, VK_NULL_HANDLE, 0);
         vkDestroyDescriptorSetLayout(m_device, m_dsetLayout,nullptr);
-        m_dsetLayout = VK_NULL_HANDLE;
+        vkDestroyDescriptorSetLayout(m_device, m_subpassInputLayout,nullptr);
+        vkDestroyDescriptorSetLayout(m_device, m_storageLayout,nullptr);
+        m_dsetLayout         = VK_NULL_HANDLE;
+        m_subpassInputLayout = VK_NULL_HANDLE;
+        m_storageLayout      = VK_NULL_HANDLE;
+        for(auto & P : m_descriptorPools)
+        {
+            vkDestroyDescriptorPool(m_device, P, nullptr);
+        }
+        m_descriptorPools.clear();
+        for(auto & S : m_setPools)
+        {
+            S = {};
+        }
+        m_setWrites.clear();
 
         m_execOrder.clear();
+        m_plan.clear();
+        m_otherPlan = {};
+        m_endOfFrame = {};
+        m_batches.clear();
+        _resetGenerated();
     }
     /**
      * @brief setRenderer
@@ -303,6 +538,273 @@ struct FrameGraphExecutor_Vulkan : public ExecutorBase
         _renderers[renderPassName] = f;
     }
 
+    /**
+     * @brief importImage
+     * @param targetName
+     * @param image
+     * @param imageView
+     * @param layout
+     *
+     * Use the application's image for a target declared with
+     * FrameGraph::importTarget( ). The image must be in layout when
+     * the frame starts, and is transitioned back to it at the end of
+     * the frame unless layout is UNDEFINED. The image and view are
+     * never destroyed by the executor.
+     *
+     * Imported images can't be used by async compute passes.
+     * This must be called before resize( )
+     */
+    void importImage(std::string const & targetName, VkImage image, VkImageView imageView, VkImageLayout layout)
+    {
+        _imports[targetName] = {image, imageView, layout};
+    }
+
+    /**
+     * @brief setFramesInFlight
+     * @param count
+     *
+     * The number of frames the application records while the GPU
+     * is still executing the previous ones. Every pass gets its own
+     * descriptor sets and secondary command buffer for each frame
+     * index, and the async compute queue gets a command pool for each
+     * frame index. operator() is then given the frame index, and the
+     * application must wait for the GPU to finish the last frame
+     * recorded with the same index before calling it again.
+     *
+     * Images are not duplicated. They are only written by the GPU and
+     * the barriers of each frame wait for the previous one, so frames
+     * in flight can share them.
+     *
+     * This must be called after init( ) and before setParallelRecording( ),
+     * setAsyncCompute( ) and resize( )
+     */
+    void setFramesInFlight(uint32_t count)
+    {
+        assert(count > 0);
+        assert(m_workers.empty() && m_queues[1].queue == VK_NULL_HANDLE);
+        m_framesInFlight = count;
+    }
+
+    /**
+     * @brief setImagelessFramebuffers
+     * @param enable
+     *
+     * Create the framebuffers with VK_FRAMEBUFFER_CREATE_IMAGELESS_BIT.
+     * The image views are then given when the render pass begins, so
+     * recreating the images at the same size keeps the framebuffers.
+     * The device must have the imagelessFramebuffer feature enabled
+     * (Vulkan 1.2 or VK_KHR_imageless_framebuffer).
+     *
+     * This should be set before the first call to resize( )
+     */
+    void setImagelessFramebuffers(bool enable)
+    {
+        m_imagelessFramebuffers = enable;
+    }
+
+    /**
+     * @brief setTransientHeap
+     * @param enable
+     *
+     * When enabled, images are not given their own allocation. They
+     * are created unbound and packed into a few large allocations based
+     * on when they are used in the graph, so images which are never
+     * alive at the same time can share the same memory, even if they
+     * have different formats or sizes. Transient attachments are
+     * kept out of the heap when the device has lazily allocated memory.
+     *
+     * This should be set before the first call to resize( )
+     */
+    void setTransientHeap(bool enable)
+    {
+        m_useTransientHeap = enable;
+    }
+
+    /**
+     * @brief setProfiling
+     * @param enable
+     * @param timestampPeriod
+     *
+     * Measure the GPU time of every pass, see getPassTimings( ). Each
+     * pass is bracketed with timestamps written into a query pool of the
+     * frame index. They are read back, without waiting, the next time
+     * operator() is given the same frame index.
+     *
+     * timestampPeriod is VkPhysicalDeviceLimits::timestampPeriod, the
+     * queues the passes are submitted to must have timestampValidBits.
+     *
+     * This should be set before the first call to resize( )
+     */
+    void setProfiling(bool enable, float timestampPeriod = 1.0f)
+    {
+        m_profiling       = enable;
+        m_timestampPeriod = timestampPeriod;
+    }
+
+    /**
+     * @brief setParallelRecording
+     * @param threadCount
+     * @param queueFamilyIndex
+     *
+     * Record each pass into its own secondary command buffer using
+     * threadCount worker threads. Passes with the same dependency level
+     * are recorded at the same time. The secondary command buffers are
+     * then executed in order from RenderInfo::commandBuffer.
+     *
+     * Each worker has its own VkCommandPool created for queueFamilyIndex.
+     * Renderers must only record commands which are valid inside a
+     * render pass. A threadCount of 0 records serially.
+     *
+     * This must be called after init( ) and before resize( )
+     */
+    void setParallelRecording(uint32_t threadCount, uint32_t queueFamilyIndex)
+    {
+        m_workerPool.stop();
+        for(auto & W : m_workers)
+        {
+            vkDestroyCommandPool(m_device, W.commandPool, nullptr);
+        }
+        m_workers.clear();
+
+        if(threadCount == 0)
+            return;
+
+        m_workers.resize(threadCount);
+        for(auto & W : m_workers)
+        {
+            VkCommandPoolCreateInfo ci = {};
+            ci.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            ci.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+            ci.queueFamilyIndex = queueFamilyIndex;
+
+            auto res = vkCreateCommandPool(m_device, &ci, nullptr, &W.commandPool);
+            if (res != VK_SUCCESS)
+            {
+                std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+                assert(res == VK_SUCCESS);
+            }
+        }
+        m_recordJob = [this](uint32_t w)
+        {
+            _recordLevel(w);
+        };
+        m_workerPool.start(threadCount);
+    }
+
+    /**
+     * @brief setAsyncCompute
+     * @param graphicsQueue
+     * @param graphicsFamily
+     * @param computeQueue
+     * @param computeFamily
+     *
+     * Execute the compute passes marked with setAsyncCompute( ) on
+     * computeQueue. The graph is split into batches, see
+     * FrameGraph::getQueueBatches( ). operator() records and submits
+     * every batch except the last graphics batch, which is recorded
+     * into RenderInfo::commandBuffer. Its submit must wait for and
+     * signal the values given by getTimelineSubmitInfo( ). The other
+     * graphics batches are submitted to graphicsQueue before it.
+     *
+     * Each queue gets a command pool for every frame in flight and
+     * a timeline semaphore.
+     * Images and buffers used by both queues are created with
+     * concurrent sharing, and are never placed in a transient heap.
+     * A null computeQueue disables async compute.
+     *
+     * This must be called after init( ) and before resize( )
+     */
+    void setAsyncCompute(VkQueue graphicsQueue, uint32_t graphicsFamily, VkQueue computeQueue, uint32_t computeFamily)
+    {
+        for(auto & Q : m_queues)
+        {
+            for(auto & F : Q.frames)
+            {
+                vkDestroyCommandPool(m_device, F.commandPool, nullptr);
+            }
+            vkDestroySemaphore(m_device, Q.timeline, nullptr);
+            Q = {};
+        }
+
+        if(computeQueue == VK_NULL_HANDLE)
+            return;
+
+        m_queues[0].queue  = graphicsQueue;
+        m_queues[0].family = graphicsFamily;
+        m_queues[1].queue  = computeQueue;
+        m_queues[1].family = computeFamily;
+        m_queueFamilies[0] = graphicsFamily;
+        m_queueFamilies[1] = computeFamily;
+        for(auto & Q : m_queues)
+        {
+            VkCommandPoolCreateInfo ci = {};
+            ci.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            ci.queueFamilyIndex = Q.family;
+
+            VkResult res = VK_SUCCESS;
+            Q.frames.resize(m_framesInFlight);
+            for(auto & F : Q.frames)
+            {
+                res = vkCreateCommandPool(m_device, &ci, nullptr, &F.commandPool);
+                if (res != VK_SUCCESS)
+                {
+                    std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+                    assert(res == VK_SUCCESS);
+                }
+            }
+
+            VkSemaphoreTypeCreateInfo ti = {};
+            ti.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+            ti.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+            ti.initialValue  = 0;
+
+            VkSemaphoreCreateInfo si = {};
+            si.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            si.pNext = &ti;
+
+            res = vkCreateSemaphore(m_device, &si, nullptr, &Q.timeline);
+            if (res != VK_SUCCESS)
+            {
+                std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+                assert(res == VK_SUCCESS);
+            }
+        }
+    }
+
+    /**
+     * @brief getTimelineSubmitInfo
+     * @return
+     *
+     * The timeline semaphore values the submit of the last
+     * RenderInfo::commandBuffer must wait for and signal. This is
+     * only valid after operator() and only when async compute is
+     * used, otherwise the semaphores are null.
+     *
+     * The wait and signal values of any binary semaphores in the
+     * same submit are ignored, but must still be given in the
+     * VkTimelineSemaphoreSubmitInfo.
+     */
+    TimelineSubmitInfo const & getTimelineSubmitInfo() const
+    {
+        return m_submitInfo;
+    }
+
+    /**
+     * @brief getTransientHeapSize
+     * @return
+     *
+     * Returns the total number of bytes allocated for the transient heaps
+     */
+    VkDeviceSize getTransientHeapSize() const
+    {
+        VkDeviceSize total = 0;
+        for(auto & h : m_transientHeaps)
+        {
+            total += h.allocation ? h.allocInfo.size : 0;
+        }
+        return total;
+    }
+
     void preResize() override
     {
         _createDescriptorSetLayout();
@@ -313,42 +815,97 @@ struct FrameGraphExecutor_Vulkan : public ExecutorBase
     }
     /**
      * @brief generateImage
-     * @param imageName
-     * @param format
-     * @param width
-     * @param height
+     * @param imageDef
      *
      * Generates the image if it doesn't already exist
      */
-    void generateImage(std::string const & imageName, FrameGraphFormat format, uint32_t width, uint32_t height) override
+    void generateImage(ImageDefinition const & imageDef) override
     {
-        bool multisampled = false;
-        int  samples      = 1;
         bool resizable    = false;
+        auto samples      = static_cast<VkSampleCountFlagBits>(imageDef.samples);
+
+        auto & imageName = imageDef.name;
+        auto   format    = imageDef.format;
+        auto   width     = imageDef.width;
+        auto   height    = imageDef.height;
+
+        // only the usages the graph needs, transient images only
+        // live inside a merged render pass
+        VkImageUsageFlags usage = imageDef.transient ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0;
+        if( imageDef.attachment )
+        {
+            usage |= isDepth(format) ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        }
+        if( imageDef.sampled )
+        {
+            usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+        }
+        if( imageDef.inputAttachment )
+        {
+            usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+        }
+        if( imageDef.storage )
+        {
+            usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+        }
 
         assert(_images.count(imageName) == 0 );
-        if(_images.count(imageName) == 0)
+        if(imageDef.imported)
+        {
+            assert(_imports.count(imageName) != 0);
+            assert(!imageDef.asyncCompute);
+
+            auto & imp = _imports.at(imageName);
+            auto & I   = _images[imageName];
+            I.image       = imp.image;
+            I.imageView   = imp.imageView;
+            I.info        = _getImageCreateInfo({width,height,1}, static_cast<VkFormat>(format), 1, 1, usage);
+            I.viewType    = VK_IMAGE_VIEW_TYPE_2D;
+            I.width       = width;
+            I.height      = height;
+            I.imported    = true;
+            GFG_INFO("Image Imported: {}   {}x{}", imageName, width, height);
+        }
+        else if(_images.count(imageName) == 0)
         {
-            VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+            // images used by both queues can't share memory, the
+            // graph does not order them against the other images
+            auto familyCount = _sharedFamilyCount(imageDef.asyncCompute);
 
-            if( isDepth(format) )
+            // transient images are given lazily allocated memory when the
+            // device has it, so they may never be backed by real memory
+            bool lazy = imageDef.transient && m_lazilyAllocatedMemory;
+
+            if(m_useTransientHeap && !imageDef.asyncCompute && !lazy)
             {
-                usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+                // memory will be bound in postImageGeneration( )
+                _images[imageName] = image_CreateUnbound(m_device,
+                                                         {width,height,1},
+                                                         static_cast<VkFormat>(format),
+                                                         VK_IMAGE_VIEW_TYPE_2D,
+                                                         1,
+                                                         imageDef.mipLevels,
+                                                         usage,
+                                                         0,
+                                                         nullptr,
+                                                         samples);
             }
             else
             {
-                usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+                _images[imageName] =  image_Create(m_device,
+                                                   m_allocator,
+                                                   {width,height,1},
+                                                   static_cast<VkFormat>(format),
+                                                   VK_IMAGE_VIEW_TYPE_2D,
+                                                   1,
+                                                   imageDef.mipLevels,
+                                                   usage,
+                                                   familyCount,
+                                                   m_queueFamilies,
+                                                   samples,
+                                                   lazy ? VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED : VMA_MEMORY_USAGE_GPU_ONLY);
             }
 
-            _images[imageName] =  image_Create(m_device,
-                                               m_allocator,
-                                               {width,height,1},
-                                               static_cast<VkFormat>(format),
-                                               VK_IMAGE_VIEW_TYPE_2D,
-                                               1,
-                                               1,
-                                               usage);
-
             _images[imageName].width     = width;
             _images[imageName].height    = height;
             _images[imageName].resizable = resizable;
@@ -362,6 +919,7 @@ struct FrameGraphExecutor_Vulkan : public ExecutorBase
         if(_images.count(imageName))
         {
             auto & img = _images.at(imageName);
+            _evictFramebuffers(img);
             _destroyImage(img);
             _images.erase(imageName);
             GFG_INFO("Image Destroyed: {}", imageName);
@@ -369,288 +927,2189 @@ struct FrameGraphExecutor_Vulkan : public ExecutorBase
     }
 
     /**
-     * @brief buildRenderPass
-     * @param renderPassName
-     * @param outputTargetImages
-     * @param inputSampledImages
+     * @brief generateBuffer
+     * @param bufferDef
      *
-     * Destroys the framebuffer and recreates it.
-     *
-     * If the renderpass already exists, it will not be destroyed
+     * Creates a device local buffer. The buffer can also be
+     * used as a transfer source/destination so renderers can
+     * clear it or read it back.
      */
-    void buildFrameBuffer(std::string const & renderPassName,
-                         std::vector<std::string> const & outputTargetImages,
-                         std::vector<std::string> const & inputSampledImages) override
+    void generateBuffer(BufferDefinition const & bufferDef) override
     {
-        auto & out = this->_nodes[renderPassName];
-        out.inputAttachments.clear();
-
-        FrameBuffer & fb = out.m_frameBuffer;
-
-        if(fb.frameBuffer)
+        assert(_buffers.count(bufferDef.name) == 0);
+
+        VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        if( hasUsage(bufferDef.usage, BufferUsage::STORAGE) )
+            usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        if( hasUsage(bufferDef.usage, BufferUsage::UNIFORM) )
+            usage |= VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        if( hasUsage(bufferDef.usage, BufferUsage::INDIRECT) )
+            usage |= VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+        if( hasUsage(bufferDef.usage, BufferUsage::VERTEX) )
+            usage |= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        if( hasUsage(bufferDef.usage, BufferUsage::INDEX) )
+            usage |= VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size        = bufferDef.size;
+        bufferInfo.usage       = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if( _sharedFamilyCount(bufferDef.asyncCompute) > 1 )
         {
-            fb.destroyFramebuffer(m_device);
-            fb.m_attachmentDesc.clear();
-            fb.attachments.clear();
+            bufferInfo.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+            bufferInfo.queueFamilyIndexCount = 2;
+            bufferInfo.pQueueFamilyIndices   = m_queueFamilies;
         }
 
-        uint32_t imageWidth  = 0;
-        uint32_t imageHeight = 0;
+        VmaAllocationCreateInfo allocCInfo = {};
+        allocCInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
-        for (auto r : inputSampledImages)
+        auto & B = _buffers[bufferDef.name];
+        B.size   = bufferDef.size;
         {
-            auto & imgId = _images.at(r);
-            out.inputAttachments.push_back( _images.at(r).imageView );
+            auto res = vmaCreateBuffer(m_allocator, &bufferInfo, &allocCInfo, &B.buffer, &B.allocation, &B.allocInfo);
+            if (res != VK_SUCCESS)
+            {
+                std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+                assert(res == VK_SUCCESS);
+            }
         }
+        GFG_INFO("Buffer Created: {}   {} bytes", bufferDef.name, bufferDef.size);
+    }
 
-        for (auto r : outputTargetImages)
-        {
-            auto & imgId = _images.at(r);
-            fb.insertColorImage(imgId.imageView, imgId.info.format);
-            imageWidth  = imgId.info.extent.width;
-            imageHeight = imgId.info.extent.height;
-        }
-        if(outputTargetImages.size() > 0 )
+    void destroyBuffer(std::string const & bufferName) override
+    {
+        if(_buffers.count(bufferName))
         {
-            fb.setExtents(imageWidth, imageHeight);
-            if(fb.renderPass == VK_NULL_HANDLE)
-                fb.createRenderPass(m_device);
-            fb.createFramebuffer(m_device);
+            auto & B = _buffers.at(bufferName);
+            vmaDestroyBuffer(m_allocator, B.buffer, B.allocation);
+            _buffers.erase(bufferName);
+            GFG_INFO("Buffer Destroyed: {}", bufferName);
         }
-        out.isInit = true;
+    }
 
-        //==========
-        if(inputSampledImages.size() == 0)
+    /**
+     * @brief postImageGeneration
+     * @param images
+     *
+     * When the transient heap is enabled, this packs all the images which
+     * do not have memory bound to them into shared allocations.
+     *
+     * Images are placed largest first at the lowest offset which does
+     * not overlap any image that is alive at the same time. Images are
+     * grouped by the memory types they can be bound to.
+     */
+    void postImageGeneration(std::vector<ImageDefinition> const & images) override
+    {
+        if(!m_useTransientHeap)
             return;
 
+        struct Placement
+        {
+            VKImageInfo * img;
+            uint32_t      firstUse;
+            uint32_t      lastUse;
+            VkDeviceSize  offset;
+        };
+
+        std::map<uint32_t, std::vector<Placement>> groups;
+        for(auto & D : images)
+        {
+            auto & I = _images.at(D.name);
+            if(I.image != VK_NULL_HANDLE && I.allocation == VK_NULL_HANDLE && I.heapIndex < 0 && !I.imported)
+            {
+                groups[I.memoryRequirements.memoryTypeBits].push_back({&I, D.firstUse, D.lastUse, 0});
+            }
+        }
+
+        for(auto & [memoryTypeBits, placements] : groups)
         {
-            if(out.descriptorPool == VK_NULL_HANDLE)
+            std::sort(placements.begin(), placements.end(), [](auto & a, auto & b)
+            {
+                return a.img->memoryRequirements.size > b.img->memoryRequirements.size;
+            });
+
+            VkMemoryRequirements heapRequirements = {};
+            heapRequirements.alignment      = 1;
+            heapRequirements.memoryTypeBits = memoryTypeBits;
+
+            auto _overlaps = [](Placement const & a, Placement const & b)
             {
-                out.descriptorPool = _createDescriptorPool();
+                bool time   = !(a.lastUse < b.firstUse || b.lastUse < a.firstUse);
+                bool memory = a.offset < b.offset + b.img->memoryRequirements.size &&
+                              b.offset < a.offset + a.img->memoryRequirements.size;
+                return time && memory;
+            };
 
-                VkDescriptorSetAllocateInfo allocInfo = {};
-                allocInfo.sType                       = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-                allocInfo.descriptorSetCount          = 1;
-                allocInfo.pSetLayouts                 = &m_dsetLayout;
-                allocInfo.descriptorPool              = out.descriptorPool;
+            for(size_t i=0;i<placements.size();i++)
+            {
+                auto & P     = placements[i];
+                auto   align = P.img->memoryRequirements.alignment;
 
-                //for(uint32_t i=0;i<3;i++)
+                // candidate offsets are the start of the heap and the end of
+                // every image placed so far. Pick the lowest one that fits.
+                VkDeviceSize best = std::numeric_limits<VkDeviceSize>::max();
+                for(size_t c=0;c<=i;c++)
                 {
-                    VkDescriptorSet dSet = {};
-                    auto res = vkAllocateDescriptorSets(m_device, &allocInfo, &dSet);
-                    if (res != VK_SUCCESS)
+                    P.offset = c == i ? 0 : placements[c].offset + placements[c].img->memoryRequirements.size;
+                    P.offset = (P.offset + align - 1) / align * align;
+                    if(P.offset >= best)
+                        continue;
+
+                    bool fits = true;
+                    for(size_t j=0;j<i && fits;j++)
                     {
-                        std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
-                        assert(res == VK_SUCCESS);
+                        fits = !_overlaps(P, placements[j]);
                     }
-                    out.descriptorSet = dSet;
+                    if(fits)
+                        best = P.offset;
                 }
+                P.offset = best;
 
+                heapRequirements.size      = std::max(heapRequirements.size, P.offset + P.img->memoryRequirements.size);
+                heapRequirements.alignment = std::max(heapRequirements.alignment, align);
             }
-        }
-        VkWriteDescriptorSet write = {};
-        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-
-        std::vector<VkDescriptorImageInfo> _imageInfo;
-        uint32_t i=0;
-        GFG_INFO("Updating Set for: {}", renderPassName);
-        for (auto & imgName : inputSampledImages)
-        {
-            auto &imgID = _images.at(imgName);
-            auto &ii    = _imageInfo.emplace_back();//.at(i);
-
-            ii.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            ii.imageView   = imgID.imageView;
-            ii.sampler     = imgID.nearestSampler;
 
-            GFG_INFO("   Adding Image: {}     image View: {}", imgName, (void*)imgID.imageView);
-            i++;
-        }
-        while(_imageInfo.size() < maxInputTextures)
-            _imageInfo.push_back(_imageInfo.back());
-
-        write.pImageInfo      = _imageInfo.data();
-        write.descriptorCount = _imageInfo.size();
-        write.dstArrayElement = 0;
-        write.dstSet          = out.descriptorSet;
-        write.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        GFG_INFO("Input Set updated, {}", renderPassName);
+            auto heapIndex = _createTransientHeap(heapRequirements);
+            auto & heap    = m_transientHeaps[static_cast<size_t>(heapIndex)];
 
-        vkUpdateDescriptorSets(m_device,1, &write,0,nullptr);
-    }
+            for(auto & P : placements)
+            {
+                auto res = vmaBindImageMemory2(m_allocator, heap.allocation, P.offset, P.img->image, nullptr);
+                if (res != VK_SUCCESS)
+                {
+                    std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+                    assert(res == VK_SUCCESS);
+                }
+                P.img->heapIndex  = heapIndex;
+                P.img->heapOffset = P.offset;
+                heap.imageCount++;
 
+                _createImageView(m_device, *P.img);
+            }
 
-    /**
+            // any image sharing memory with another needs an
+            // aliasing barrier before it is written to
+            for(auto & P : placements)
+            {
+                for(auto & Q : placements)
+                {
+                    if(&P != &Q &&
+                       P.offset < Q.offset + Q.img->memoryRequirements.size &&
+                       Q.offset < P.offset + P.img->memoryRequirements.size)
+                    {
+                        P.img->aliased = true;
+                    }
+                }
+            }
+            GFG_INFO("Transient Heap Created: {} bytes for {} images", heapRequirements.size, placements.size());
+        }
+    }
+
+    /**
+     * @brief buildRenderPass
+     * @param renderPassName
+     * @param outputTargetImages
+     * @param inputSampledImages
+     *
+     * Destroys the framebuffer and collects the attachments
+     * for the new one.
+     *
+     * If the renderpass already exists, it will not be destroyed
+     */
+    void buildFrameBuffer(std::string const & renderPassName,
+                         std::vector<std::string> const & outputTargetImages,
+                         std::vector<std::string> const & inputSampledImages,
+                         std::vector<SamplerDefinition> const & inputSamplers) override
+    {
+        auto & out = this->_nodes[renderPassName];
+        out.inputAttachments.clear();
+
+        FrameBuffer & fb = out.m_frameBuffer;
+
+        // the framebuffer belongs to the cache
+        fb.frameBuffer = VK_NULL_HANDLE;
+        fb.m_attachmentDesc.clear();
+        fb.attachments.clear();
+        fb.attachmentUsage.clear();
+        fb.m_subpasses.clear();
+        fb.m_dependencies.clear();
+
+        uint32_t imageWidth  = 0;
+        uint32_t imageHeight = 0;
+
+        for (auto r : inputSampledImages)
+        {
+            out.inputAttachments.push_back( _subresource(r).view );
+        }
+
+        out.aliasingBarrier = false;
+        for (auto r : outputTargetImages)
+        {
+            auto   sub   = _subresource(r);
+            auto & imgId = *sub.image;
+            out.aliasingBarrier |= imgId.aliased;
+            fb.insertColorImage(sub.view, imgId.info.format, imgId.info.usage, imgId.info.samples);
+            imageWidth  = sub.width;
+            imageHeight = sub.height;
+        }
+        // the render pass and framebuffer are created in buildExecutionPlan( )
+        // once we know which passes are merged into the same render pass
+        if(outputTargetImages.size() > 0 )
+        {
+            fb.setExtents(imageWidth, imageHeight);
+        }
+        out.isInit = true;
+        out.dirty  = true;
+
+        //==========
+        if(inputSampledImages.size() == 0)
+            return;
+
+        std::vector<VkDescriptorImageInfo> _imageInfo;
+        GFG_INFO("Updating Set for: {}", renderPassName);
+        for (size_t k=0; k<inputSampledImages.size(); k++)
+        {
+            auto &imgName = inputSampledImages[k];
+            auto  sub     = _subresource(imgName);
+            auto &ii      = _imageInfo.emplace_back();
+
+            ii.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            ii.imageView   = sub.view;
+            ii.sampler     = _getSampler(inputSamplers[k]);
+
+            GFG_INFO("   Adding Image: {}     image View: {}", imgName, (void*)sub.view);
+        }
+        _queueSetWrite(out.descriptorSet, SAMPLED_SET, _imageInfo);
+    }
+
+    /**
+     * @brief buildComputePass
+     * @param computePassName
+     * @param storageImages
+     * @param inputSampledImages
+     *
+     * Writes the storage image set and the sampled image set
+     * of a compute pass. Compute passes have no framebuffer.
+     */
+    void buildComputePass(std::string const & computePassName,
+                          std::vector<std::string> const & storageImages,
+                          std::vector<std::string> const & inputSampledImages,
+                          std::vector<SamplerDefinition> const & inputSamplers) override
+    {
+        auto & out = this->_nodes[computePassName];
+        out.inputAttachments.clear();
+        out.aliasingBarrier = false;
+
+        std::vector<VkDescriptorImageInfo> storageInfo;
+        for(auto & r : storageImages)
+        {
+            auto sub = _subresource(r);
+            out.aliasingBarrier |= sub.image->aliased;
+
+            auto & ii = storageInfo.emplace_back();
+            ii.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            ii.imageView   = sub.view;
+        }
+        if(storageImages.size())
+        {
+            auto sub = _subresource(storageImages.front());
+            out.width  = sub.width;
+            out.height = sub.height;
+            _queueSetWrite(out.storageImageSet, STORAGE_SET, storageInfo);
+        }
+
+        std::vector<VkDescriptorImageInfo> sampledInfo;
+        for(size_t k=0;k<inputSampledImages.size();k++)
+        {
+            auto view = _subresource(inputSampledImages[k]).view;
+            out.inputAttachments.push_back(view);
+
+            auto & ii = sampledInfo.emplace_back();
+            ii.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            ii.imageView   = view;
+            ii.sampler     = _getSampler(inputSamplers[k]);
+        }
+        if(sampledInfo.size())
+        {
+            _queueSetWrite(out.descriptorSet, SAMPLED_SET, sampledInfo);
+        }
+        out.isInit = true;
+    }
+
+
+    /**
      * @brief destroyFrameBuffer
      * @param renderPassName
      *
-     * Completely destroys the framebuffer and the renderpass
+     * Releases the node's framebuffer. The framebuffer and render
+     * pass are owned by the caches, see _createRenderPasses( )
      */
     void destroyFrameBuffer(std::string const & renderPassName) override
     {
         auto & out = this->_nodes[renderPassName];
-        out.m_frameBuffer.destroyFramebuffer(m_device);
-        //out.m_frameBuffer.destroyRenderPass(m_device);
+        out.m_frameBuffer.frameBuffer = VK_NULL_HANDLE;
         out.m_frameBuffer.attachments.clear();
+        out.m_frameBuffer.attachmentUsage.clear();
         out.m_frameBuffer.imgHeight = 0;
         out.m_frameBuffer.imgWidth = 0;
         //_nodes.erase(renderPassName);
     }
 
+    /**
+     * @brief destroyPass
+     * @param passName
+     *
+     * Puts the descriptor sets of the pass back on the free lists
+     * and forgets the node. Its framebuffer is released by the next
+     * buildExecutionPlan( ) once no node uses it.
+     */
+    void destroyPass(std::string const & passName) override
+    {
+        auto it = _nodes.find(passName);
+        if(it == _nodes.end())
+            return;
+
+        auto & N = it->second;
+        auto _release = [&](std::vector<VkDescriptorSet> & sets, SetKind kind)
+        {
+            auto & free = m_setPools[kind].free;
+            free.insert(free.end(), sets.begin(), sets.end());
+            sets.clear();
+        };
+        _release(N.descriptorSet,   SAMPLED_SET);
+        _release(N.subpassInputSet, SUBPASS_INPUT_SET);
+        _release(N.storageImageSet, STORAGE_SET);
+        _nodes.erase(it);
+    }
+
+    /**
+     * @brief operator ()
+     * @param G
+     * @param Ri
+     *
+     * Call the framegraph to execute the render functions.
+     *
+     * The RenderInfo struct needs to be filled in. This contains
+     * information about the current swapchain Image that you are rendering
+     * to.
+     *
+     * The swapchain is not managed by teh FrameGraph as it should be
+     * managed by your window manager or your main loop.
+     *
+     * frameIndex selects the descriptor sets and command buffers
+     * to use, see setFramesInFlight( ).
+     */
+    void operator()(FrameGraph const &, RenderInfo const & Ri, uint32_t frameIndex = 0)
+    {
+        assert(frameIndex < m_framesInFlight);
+        m_frameIndex = frameIndex;
+
+        if(m_pingPong)
+        {
+            _swapPlans();
+        }
+        if(m_batches.size())
+        {
+            _beginBatches(Ri);
+        }
+        if(m_profiling)
+        {
+            _readTimestamps();
+        }
+
+        if(m_workers.size())
+        {
+            _executeParallel(Ri);
+        }
+        else
+        {
+            for(uint32_t i=0;i<m_plan.size();i++)
+            {
+                // m_frame has enough capacity reserved for every pass
+                // so copying the prebuilt frame does not allocate.
+                auto & P   = m_plan[i];
+                auto & F   = m_frame;
+                auto   cmd = _commandBuffer(P, Ri);
+                _prepareFrame(F, P, Ri, m_frameIndex);
+                F.commandBuffer = cmd;
+
+                if(P.aliasingBarrier)
+                {
+                    _aliasingBarrier(cmd);
+                }
+                _recordBarriers(cmd, P);
+                _resetTimestamps(cmd, i, P);
+
+                _writeTimestamp(cmd, i, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+                (*P.renderer)(F);
+                _writeTimestamp(cmd, i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+            }
+        }
+
+        // return the imported images to the layout the application expects
+        _recordBarriers(Ri.commandBuffer, m_endOfFrame);
+
+        if(m_batches.size())
+        {
+            _submitBatches();
+        }
+    }
+
+    // passes which read at the same pixel are merged into subpasses of one render pass
+    bool mergesRenderPasses() const override
+    {
+        return true;
+    }
+
+    /**
+     * @brief buildExecutionPlan
+     * @param G
+     *
+     * Resolves the renderer and prebuilds the Frame of every pass,
+     * in execution order. Only the swapchain and command buffer
+     * are filled in by operator().
+     */
+    void buildExecutionPlan(FrameGraph const & G) override
+    {
+        // History targets swap their images every frame, so odd frames
+        // have their own plan. The plan of even frames is built first and
+        // put aside, operator() swaps it back in for the first frame.
+        m_pingPong = G.usesHistory();
+
+        // creating the render passes queues the subpass input sets, so
+        // the descriptor sets of every node can be written at once
+        m_resizeCount++;
+        _createRenderPasses(G, 0);
+        if(m_pingPong)
+        {
+            _createRenderPasses(G, 1);
+        }
+        _writeDescriptorSets();
+
+        // framebuffers no node uses anymore, eg: of the previous extent
+        for(auto it = m_framebuffers.begin(); it != m_framebuffers.end(); )
+        {
+            if(it->second.resize == m_resizeCount)
+            {
+                ++it;
+                continue;
+            }
+            vkDestroyFramebuffer(m_device, it->second.frameBuffer, nullptr);
+            it = m_framebuffers.erase(it);
+            m_stats.framebuffersDestroyed++;
+        }
+
+        if(m_pingPong)
+        {
+            _buildPlan(G, 0);
+            _swapPlans();
+        }
+        _buildPlan(G, m_pingPong ? 1 : 0);
+        _buildQueryPools();
+    }
+
+protected:
+    void _buildPlan(FrameGraph const & G, uint32_t parity)
+    {
+        auto & passes      = G.getPasses();
+        auto & buffers     = G.getBuffers();
+        auto & bufferTable = G.getBufferTable();
+
+        m_plan.clear();
+        m_plan.reserve(m_execOrder.size());
+
+        size_t maxInputAttachments = 0;
+        size_t maxClearValues      = 0;
+        size_t maxInputBuffers     = 0;
+        size_t maxOutputBuffers    = 0;
+
+        for(size_t i=0;i<m_execOrder.size();i++)
+        {
+            auto   p    = m_execOrder[i];
+            auto & name = passes.name[p.index];
+            auto & NN   = _nodes.at(_nodeName(G, p, parity));
+            auto & RN   = _nodes.at(_nodeName(G, passes.renderPass[p.index], parity));
+            auto & P    = m_plan.emplace_back();
+            auto & F    = P.frame;
+
+            // the map node is stable, so a renderer which is
+            // set after resize( ) will still be picked up.
+            P.renderer          = &_renderers[name];
+            P.toSwapchain       = passes.type[p.index] == PassType::GRAPHICS && passes.getOutputs(p).empty();
+
+            // barriers can't be recorded inside a render pass, so the
+            // first subpass waits for all the merged passes.
+            m_plan[i - passes.subpass[p.index]].aliasingBarrier |= NN.aliasingBarrier;
+            m_plan[i - passes.subpass[p.index]].timestampCount  += 2;
+
+            F.inputAttachmentSetLayout = NN.inputAttachments.size() == 0 ? VK_NULL_HANDLE : m_dsetLayout;
+            F.subpass                  = passes.subpass[p.index];
+            F.lastSubpass              = i+1 == m_execOrder.size() || passes.renderPass[m_execOrder[i+1].index] != passes.renderPass[p.index];
+            F.subpassInputSetLayout    = NN.subpassInputSet.empty() ? VK_NULL_HANDLE : m_subpassInputLayout;
+            F.isCompute                = passes.type[p.index] == PassType::COMPUTE;
+            F.resizable                = _windowSized(G, p) && !P.toSwapchain;
+            F.samples                  = passes.samples[p.index];
+            P.scale                    = _windowScale(G, p);
+
+            // the descriptor sets are filled in by operator() for the frame index
+            P.frames.resize(m_framesInFlight);
+            for(uint32_t f=0;f<m_framesInFlight;f++)
+            {
+                auto & R = P.frames[f];
+                R.inputAttachmentSet = NN.descriptorSet.empty()   ? VK_NULL_HANDLE : NN.descriptorSet[f];
+                R.subpassInputSet    = NN.subpassInputSet.empty() ? VK_NULL_HANDLE : NN.subpassInputSet[f];
+                R.storageImageSet    = NN.storageImageSet.empty() ? VK_NULL_HANDLE : NN.storageImageSet[f];
+            }
+
+            for(auto b : passes.getInputBuffers(p))
+            {
+                F.inputBuffers.push_back(_buffers.at(buffers[bufferTable.allocation[b.index].index].name).buffer);
+            }
+            for(auto b : passes.getOutputBuffers(p))
+            {
+                F.outputBuffers.push_back(_buffers.at(buffers[bufferTable.allocation[b.index].index].name).buffer);
+            }
+
+            if(F.isCompute)
+            {
+                F.storageImageSetLayout = NN.storageImageSet.empty() ? VK_NULL_HANDLE : m_storageLayout;
+                F.inputAttachments      = NN.inputAttachments;
+                F.imageWidth            = NN.width;
+                F.imageHeight           = NN.height;
+                F.renderableWidth       = NN.width;
+                F.renderableHeight      = NN.height;
+            }
+            else if(P.toSwapchain)
+            {
+                F.inputAttachments = NN.inputAttachments;
+
+                F.clearValue.emplace_back();
+                auto & cv = F.clearValue.emplace_back();
+                cv.depthStencil.stencil = 0;
+                cv.depthStencil.depth = 1.0f;
+            }
+            else
+            {
+                F.frameBuffer      = RN.m_frameBuffer.frameBuffer;
+                F.renderPass       = RN.m_frameBuffer.renderPass;
+                F.attachmentBeginInfo = m_imagelessFramebuffers ? &RN.m_frameBuffer.attachmentBeginInfo : nullptr;
+                F.inputAttachments = NN.m_frameBuffer.attachments;
+                F.imageWidth       = RN.m_frameBuffer.imgWidth;
+                F.imageHeight      = RN.m_frameBuffer.imgHeight;
+                F.renderableWidth  = RN.m_frameBuffer.imgWidth;
+                F.renderableHeight = RN.m_frameBuffer.imgHeight;
+
+                // The first subpass begins the render pass, so it needs a
+                // clear value for every attachment of the merged passes.
+                // Its own outputs are first.
+                for(auto & a : (F.subpass == 0 ? RN : NN).m_frameBuffer.m_attachmentDesc)
+                {
+                    auto &cv = F.clearValue.emplace_back();
+                    if( !isDepth(static_cast<FrameGraphFormat>(a.format)) )
+                    {
+                        cv.color.float32[0] = 0.0f;
+                        cv.color.float32[1] = 0.0f;
+                        cv.color.float32[2] = 0.0f;
+                        cv.color.float32[3] = 0.0f;
+                    }
+                    else
+                    {
+                        cv.depthStencil.stencil = 0;
+                        cv.depthStencil.depth = 1.0f;
+                    }
+                }
+            }
+
+            maxInputAttachments = std::max(maxInputAttachments, F.inputAttachments.size());
+            maxClearValues      = std::max(maxClearValues, F.clearValue.size());
+            maxInputBuffers     = std::max(maxInputBuffers, F.inputBuffers.size());
+            maxOutputBuffers    = std::max(maxOutputBuffers, F.outputBuffers.size());
+        }
+
+        m_frame.inputAttachments.reserve(maxInputAttachments);
+        m_frame.clearValue.reserve(maxClearValues);
+        m_frame.inputBuffers.reserve(maxInputBuffers);
+        m_frame.outputBuffers.reserve(maxOutputBuffers);
+
+        _buildBatches(G);
+        _buildBarriers(G, parity);
+
+        if(m_workers.empty())
+            return;
+
+        // group the plan by dependency level and hand out the passes
+        // of each level to the workers in turn. Each pass gets a
+        // secondary command buffer from its worker's pool.
+        uint32_t levelCount = 0;
+        for(auto p : m_execOrder)
+        {
+            levelCount = std::max(levelCount, passes.level[p.index] + 1);
+        }
+        m_levelOffset.assign(levelCount + 1, 0);
+        for(auto p : m_execOrder)
+        {
+            m_levelOffset[passes.level[p.index] + 1]++;
+        }
+        for(uint32_t l=0;l<levelCount;l++)
+        {
+            m_levelOffset[l+1] += m_levelOffset[l];
+        }
+
+        m_levelPasses.resize(m_plan.size());
+        auto fill = m_levelOffset;
+        for(auto & W : m_workers)
+        {
+            W.used = 0;
+            W.frame.inputAttachments.reserve(maxInputAttachments);
+            W.frame.clearValue.reserve(maxClearValues);
+            W.frame.inputBuffers.reserve(maxInputBuffers);
+            W.frame.outputBuffers.reserve(maxOutputBuffers);
+        }
+        for(uint32_t i=0;i<m_plan.size();i++)
+        {
+            auto l     = passes.level[m_execOrder[i].index];
+            auto slot  = fill[l]++;
+            auto & P   = m_plan[i];
+            auto & W   = m_workers[(slot - m_levelOffset[l]) % m_workers.size()];
+
+            m_levelPasses[slot] = i;
+
+            // passes on the compute queue are recorded straight
+            // into their batch's command buffer
+            if(P.asyncCompute)
+            {
+                P.worker = PassRecord::noWorker;
+                continue;
+            }
+
+            // one secondary command buffer for each frame in flight
+            for(auto & R : P.frames)
+            {
+                if(W.used == W.commandBuffers.size())
+                {
+                    VkCommandBufferAllocateInfo ai = {};
+                    ai.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                    ai.commandPool        = W.commandPool;
+                    ai.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                    ai.commandBufferCount = 1;
+
+                    auto & cmd = W.commandBuffers.emplace_back();
+                    auto res = vkAllocateCommandBuffers(m_device, &ai, &cmd);
+                    if (res != VK_SUCCESS)
+                    {
+                        std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+                        assert(res == VK_SUCCESS);
+                    }
+                }
+                R.secondaryBuffer = W.commandBuffers[W.used++];
+            }
+
+            P.clearValues.reserve(P.frame.clearValue.size());
+            P.worker = static_cast<uint32_t>(&W - m_workers.data());
+        }
+    }
+
+    // Swaps the current plan with the one put aside
+    void _swapPlans()
+    {
+        std::swap(m_plan,           m_otherPlan.plan);
+        std::swap(m_barriers,       m_otherPlan.barriers);
+        std::swap(m_bufferBarriers, m_otherPlan.bufferBarriers);
+        std::swap(m_endOfFrame,     m_otherPlan.endOfFrame);
+    }
+
+    struct VKNodeInfo
+    {
+        // the images that the render pass will
+        // sample from
+        std::vector<VkImageView> inputAttachments;
+
+        bool                     isInit = false;
+
+        // buildFrameBuffer( ) was called since the render pass
+        // was last created, see _createRenderPasses( )
+        bool                     dirty  = false;
+
+        // the sets of each frame in flight, empty if the node has none.
+        // They are allocated from the shared pool, see _writeDescriptorSets( )
+        std::vector<VkDescriptorSet> descriptorSet;
+        std::vector<VkDescriptorSet> subpassInputSet;
+        std::vector<VkDescriptorSet> storageImageSet;
+
+        // the extent of a compute pass, taken from its first storage image
+        uint32_t                 width  = 0;
+        uint32_t                 height = 0;
+
+        // true if any of the output images shares memory
+        // with another image in a transient heap
+        bool                     aliasingBarrier = false;
+
+        FrameBuffer m_frameBuffer;
+    };
+
+    // Everything operator() needs to execute a single pass.
+    // Built by buildExecutionPlan( ) in execution order.
+    struct PassRecord
+    {
+        std::function<void(Frame &)> * renderer = nullptr;
+
+        // the image barriers recorded before the pass are
+        // m_barriers[ barrierOffset .. barrierOffset+barrierCount )
+        // and the buffer barriers are stored the same way
+        uint32_t             barrierOffset = 0;
+        uint32_t             barrierCount  = 0;
+        uint32_t             bufferBarrierOffset = 0;
+        uint32_t             bufferBarrierCount  = 0;
+        VkPipelineStageFlags srcStageMask  = 0;
+        VkPipelineStageFlags dstStageMask  = 0;
+
+        bool  toSwapchain     = false;
+        bool  aliasingBarrier = false;
+
+        // queries can't be reset inside a render pass, so the first
+        // subpass resets the timestamps of all the merged passes
+        uint32_t timestampCount = 0;
+
+        bool  asyncCompute    = false; // executed on the compute queue
+        float scale           = 1.0f;  // of the window, if frame.resizable
+
+        // index into m_batches, when async compute is used
+        uint32_t batch = 0;
+
+        // prebuilt frame, the swapchain values are
+        // filled in by operator()
+        Frame frame = {};
+
+        // the resources of the pass for each frame in flight
+        struct InFlight
+        {
+            VkDescriptorSet inputAttachmentSet = VK_NULL_HANDLE;
+            VkDescriptorSet subpassInputSet    = VK_NULL_HANDLE;
+            VkDescriptorSet storageImageSet    = VK_NULL_HANDLE;
+            VkCommandBuffer secondaryBuffer    = VK_NULL_HANDLE; // when recording in parallel
+        };
+        std::vector<InFlight> frames;
+
+        // used when recording in parallel
+        static constexpr uint32_t      noWorker        = std::numeric_limits<uint32_t>::max();
+        uint32_t                       worker          = 0;
+        VkCommandBufferInheritanceInfo inheritanceInfo = {};
+        std::vector<VkClearValue>      clearValues; // as set by the renderer
+    };
+
+    struct RecordingWorker
+    {
+        VkCommandPool                commandPool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> commandBuffers;
+        size_t                       used  = 0; // number of commandBuffers given to passes
+        Frame                        frame = {};
+    };
+
+    // a queue used for async compute, m_queues[ QueueType ]
+    struct AsyncQueue
+    {
+        // the command buffers of a frame in flight
+        struct InFlight
+        {
+            VkCommandPool                commandPool = VK_NULL_HANDLE;
+            std::vector<VkCommandBuffer> commandBuffers; // one for each batch the executor submits
+            uint64_t                     submitted   = 0; // signalled by the last batch submitted with this frame index
+        };
+
+        VkQueue                      queue       = VK_NULL_HANDLE;
+        uint32_t                     family      = 0;
+        std::vector<InFlight>        frames;
+        VkSemaphore                  timeline    = VK_NULL_HANDLE;
+        uint64_t                     value       = 0; // signalled by the last batch of the previous frame
+        uint32_t                     batchCount  = 0; // batches in a frame
+    };
+
+    // A FrameGraph QueueBatch with the values of its timeline
+    // semaphores relative to AsyncQueue::value
+    struct BatchRecord
+    {
+        uint32_t        queue             = 0;
+        uint32_t        indexInQueue      = 0;
+        uint64_t        signalOffset      = 0;
+        uint64_t        waitOffset        = 0; // 0 if it does not wait for a batch of this frame
+        bool            waitPreviousFrame = false;
+        VkCommandBuffer commandBuffer     = VK_NULL_HANDLE; // of the current frame index
+    };
+
+    // the kinds of descriptor set a node can have, as an index into m_setPools
+    enum SetKind : uint32_t
+    {
+        SAMPLED_SET,
+        SUBPASS_INPUT_SET,
+        STORAGE_SET,
+        SET_KIND_COUNT
+    };
+
+    // the sets of one kind in the shared descriptor pool
+    struct SetPool
+    {
+        VkDescriptorSetLayout        layout    = VK_NULL_HANDLE;
+        VkDescriptorType             type      = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        uint32_t                     allocated = 0; // sets allocated from the pools
+        std::vector<VkDescriptorSet> free;          // allocated, but not used by any node
+    };
+
+    // a write queued by _queueSetWrite( )
+    struct SetWrite
+    {
+        std::vector<VkDescriptorSet> *     sets = nullptr; // the node's sets
+        SetKind                            kind = SAMPLED_SET;
+        std::vector<VkDescriptorImageInfo> imageInfo;
+    };
+
+    struct VKImportInfo
+    {
+        VkImage       image     = VK_NULL_HANDLE;
+        VkImageView   imageView = VK_NULL_HANDLE;
+        VkImageLayout layout    = VK_IMAGE_LAYOUT_UNDEFINED; // at the start and end of the frame
+    };
+
+    struct VKBufferInfo
+    {
+        VkBuffer          buffer     = VK_NULL_HANDLE;
+        VmaAllocation     allocation = VK_NULL_HANDLE;
+        VmaAllocationInfo allocInfo  = {};
+        VkDeviceSize      size       = 0;
+    };
+
+    struct TransientHeap
+    {
+        VmaAllocation     allocation = VK_NULL_HANDLE;
+        VmaAllocationInfo allocInfo  = {};
+        uint32_t          imageCount = 0; // number of images still bound to this heap
+    };
+
+    struct VKImageInfo
+    {
+        VkImage     image     = VK_NULL_HANDLE;
+        VkImageView imageView = VK_NULL_HANDLE;
+
+        // one view per mip level, if the image has more than one
+        std::vector<VkImageView> mipViews;
+
+        uint32_t   width     = 0;
+        uint32_t   height    = 0;
+
+        bool       resizable = true;
+
+        VkImageCreateInfo info       = {};
+        VmaAllocation     allocation = {};
+        VmaAllocationInfo allocInfo  = {};
+        VkImageViewType   viewType   = {};
+
+        // used when the image is bound to a transient heap
+        // instead of having its own allocation
+        VkMemoryRequirements memoryRequirements = {};
+        int32_t              heapIndex          = -1;
+        VkDeviceSize         heapOffset         = 0;
+        bool                 aliased            = false;
+
+        bool                 imported           = false; // owned by the application
+
+        std::vector<VkDescriptorImageInfo> _imageInfo; // for writes
+    };
+
+    // a single mip level of an image, see _subresource( )
+    struct Subresource
+    {
+        VKImageInfo * image  = nullptr;
+        VkImageView   view   = VK_NULL_HANDLE;
+        uint32_t      mip    = 0;
+        uint32_t      width  = 0;
+        uint32_t      height = 0;
+    };
+
+    // The image, view and extent of a name given by resize( ). Images
+    // with more than one mip level are only used one level at a time.
+    Subresource _subresource(std::string const & name)
+    {
+        Subresource S;
+        S.image  = &_images.at(_splitMipName(name, S.mip));
+        S.view   = S.image->mipViews.empty() ? S.image->imageView : S.image->mipViews[S.mip];
+        S.width  = std::max(S.image->info.extent.width  >> S.mip, 1u);
+        S.height = std::max(S.image->info.extent.height >> S.mip, 1u);
+        return S;
+    }
+
+    void _destroyImage(VKImageInfo &img)
+    {
+        // imported images belong to the application. Samplers
+        // are shared, see _getSampler( )
+        if(img.imported)
+        {
+            img.imageView = VK_NULL_HANDLE;
+            img.image     = VK_NULL_HANDLE;
+        }
+        if(img.imageView)
+            vkDestroyImageView(m_device, img.imageView, nullptr);
+        for(auto v : img.mipViews)
+            vkDestroyImageView(m_device, v, nullptr);
+        img.mipViews.clear();
+        if(img.image)
+        {
+            if(img.allocation)
+                vmaDestroyImage(m_allocator, img.image, img.allocation);
+            else
+                vkDestroyImage(m_device, img.image, nullptr);
+        }
+        if(img.heapIndex >= 0)
+        {
+            auto & heap = m_transientHeaps[static_cast<size_t>(img.heapIndex)];
+            if(--heap.imageCount == 0)
+            {
+                vmaFreeMemory(m_allocator, heap.allocation);
+                heap = {};
+            }
+            img.heapIndex = -1;
+        }
+        img.imageView      = VK_NULL_HANDLE;
+        img.image          = VK_NULL_HANDLE;
+    }
+
+    /**
+     * Finds the render pass and framebuffer of every graphics pass
+     * which has outputs. Passes which the FrameGraph merged share the render pass
+     * and framebuffer of the first pass in the merge, with one subpass
+     * each.
+     *
+     * Render passes are cached by renderPassKey( ), so passes with the
+     * same attachments share a VkRenderPass and it stays the same across
+     * resizes. Framebuffers are cached by render pass, extent and
+     * attachments; imageless framebuffers do not depend on the image views,
+     * so recreating the images does not recreate them.
+     *
+     * Only the render passes whose first pass was rebuilt by resize( ) are
+     * described again. The others keep their render pass and framebuffer,
+     * which are marked as used so they are not pruned.
+     */
+    void _createRenderPasses(FrameGraph const & G, uint32_t parity)
+    {
+        auto & passes  = G.getPasses();
+
+        for(size_t first=0; first<m_execOrder.size(); )
+        {
+            auto rp   = m_execOrder[first];
+            auto last = first+1;
+            while(last < m_execOrder.size() && passes.renderPass[m_execOrder[last].index] == rp)
+                last++;
+
+            // other render passes are shared by both parities
+            bool built = parity && !passes.history[rp.index];
+
+            if(!built && passes.type[rp.index] == PassType::GRAPHICS && !passes.getOutputs(rp).empty())
+            {
+                auto & N  = _nodes.at(_nodeName(G, rp, parity));
+                auto & fb = N.m_frameBuffer;
+                if(!N.dirty)
+                {
+                    m_framebuffers.at(_framebufferKey(fb)).resize = m_resizeCount;
+                    first = last;
+                    continue;
+                }
+                N.dirty = false;
+
+                if(last - first > 1)
+                {
+                    _createSubpasses(G, first, last, parity);
+                }
+                _setAttachmentOps(G, first, last, parity);
+                auto & renderPass = m_renderPasses[fb.renderPassKey()];
+                if(renderPass == VK_NULL_HANDLE)
+                {
+                    fb.renderPass = VK_NULL_HANDLE;
+                    fb.createRenderPass(m_device);
+                    renderPass = fb.renderPass;
+                    m_stats.renderPassesCreated++;
+                }
+                fb.renderPass = renderPass;
+
+                auto & cached = m_framebuffers[_framebufferKey(fb)];
+                if(cached.frameBuffer == VK_NULL_HANDLE)
+                {
+                    fb.frameBuffer = VK_NULL_HANDLE;
+                    fb.createFramebuffer(m_device, m_imagelessFramebuffers);
+                    cached.frameBuffer = fb.frameBuffer;
+                    m_stats.framebuffersCreated++;
+                }
+                cached.resize  = m_resizeCount;
+                fb.frameBuffer = cached.frameBuffer;
+
+                fb.attachmentBeginInfo                 = {};
+                fb.attachmentBeginInfo.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO;
+                fb.attachmentBeginInfo.attachmentCount = static_cast<uint32_t>(fb.attachments.size());
+                fb.attachmentBeginInfo.pAttachments    = fb.attachments.data();
+            }
+            first = last;
+        }
+    }
+
+    // Destroys the cached framebuffers which use the views of img. The
+    // driver can reuse the handle values of destroyed views, so a stale
+    // framebuffer could otherwise match the key of a new image's views.
+    void _evictFramebuffers(VKImageInfo const & img)
+    {
+        if(m_imagelessFramebuffers)
+            return;
+
+        auto _usesImage = [&](uint64_t view)
+        {
+            if(view == 0)
+                return false;
+            if(view == reinterpret_cast<uint64_t>(img.imageView))
+                return true;
+            for(auto v : img.mipViews)
+            {
+                if(view == reinterpret_cast<uint64_t>(v))
+                    return true;
+            }
+            return false;
+        };
+
+        for(auto it = m_framebuffers.begin(); it != m_framebuffers.end(); )
+        {
+            // the views follow the render pass and the extent, see _framebufferKey( )
+            auto & key = it->first;
+            if(std::none_of(key.begin() + 3, key.end(), _usesImage))
+            {
+                ++it;
+                continue;
+            }
+            vkDestroyFramebuffer(m_device, it->second.frameBuffer, nullptr);
+            it = m_framebuffers.erase(it);
+            m_stats.framebuffersDestroyed++;
+        }
+    }
+
+    // the key of fb's framebuffer in m_framebuffers
+    std::vector<uint64_t> _framebufferKey(FrameBuffer const & fb) const
+    {
+        std::vector<uint64_t> key = { reinterpret_cast<uint64_t>(fb.renderPass), fb.imgWidth, fb.imgHeight };
+        for(size_t a=0;a<fb.attachments.size();a++)
+        {
+            key.push_back(m_imagelessFramebuffers ? fb.attachmentUsage[a] : reinterpret_cast<uint64_t>(fb.attachments[a]));
+        }
+        return key;
+    }
+
+    /**
+     * Adds the attachments of the merged passes m_execOrder[first..last)
+     * to the first pass's framebuffer and describes their subpasses.
+     */
+    void _createSubpasses(FrameGraph const & G, size_t first, size_t last, uint32_t parity)
+    {
+        auto & passes  = G.getPasses();
+        auto & targets = G.getTargets();
+        auto & images  = G.getImages();
+
+        auto   rp = m_execOrder[first];
+        auto & fb = _nodes.at(_nodeName(G, rp, parity)).m_frameBuffer;
+
+        // attachment index of each target, and the subpass
+        // in which each attachment is written and last read
+        std::map<uint32_t, uint32_t> attachment;
+        std::vector<uint32_t>        writtenIn;
+        std::vector<uint32_t>        lastReadIn;
+
+        for(auto t : passes.getOutputs(rp))
+        {
+            attachment[t.index] = static_cast<uint32_t>(attachment.size());
+        }
+
+        for(size_t i=first;i<last;i++)
+        {
+            auto   p  = m_execOrder[i];
+            auto   sp = static_cast<uint32_t>(i - first);
+            auto & NN = _nodes.at(_nodeName(G, p, parity));
+            auto & S  = fb.m_subpasses.emplace_back();
+
+            for(auto t : passes.getOutputs(p))
+            {
+                auto resolveSource = targets.resolveSource[t.index];
+                if(p != rp)
+                {
+                    auto sub = _subresource(_mipName(images[targets.getImage(t, parity).index].name, targets.mip[t.index]));
+                    attachment[t.index] = static_cast<uint32_t>(fb.attachments.size());
+                    fb.insertColorImage(sub.view, sub.image->info.format, sub.image->info.usage, sub.image->info.samples);
+                }
+                auto a = attachment.at(t.index);
+                if(resolveSource.valid())
+                {
+                    // resolved from the color attachment before it
+                    S.resolveAttachments.resize(S.colorAttachments.size(), VK_ATTACHMENT_UNUSED);
+                    S.resolveAttachments.back() = a;
+                }
+                else if(isDepth(targets.format[t.index]))
+                    S.depthAttachment = static_cast<int32_t>(a);
+                else
+                    S.colorAttachments.push_back(a);
+
+                writtenIn.resize(fb.attachments.size(), 0);
+                lastReadIn.resize(fb.attachments.size(), 0);
+                writtenIn[a]  = sp;
+                lastReadIn[a] = sp;
+            }
+
+            if(!S.resolveAttachments.empty())
+                S.resolveAttachments.resize(S.colorAttachments.size(), VK_ATTACHMENT_UNUSED);
+
+            std::vector<VkDescriptorImageInfo> inputInfo;
+            auto subpassInputs = passes.getSubpassInputs(p);
+            for(uint32_t k=0;k<subpassInputs.size();k++)
+            {
+                if(!subpassInputs[k])
+                    continue;
+
+                auto t     = passes.getInputs(p)[k];
+                auto a     = attachment.at(t.index);
+                bool depth = isDepth(targets.format[t.index]);
+                S.inputAttachments.push_back(a);
+                lastReadIn[a] = sp;
+
+                auto & ii = inputInfo.emplace_back();
+                ii.imageView   = fb.attachments[a];
+                ii.imageLayout = depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+                VkSubpassDependency & d = fb.m_dependencies.emplace_back();
+                d.srcSubpass      = writtenIn[a];
+                d.dstSubpass      = sp;
+                d.srcStageMask    = depth ? VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+                d.dstStageMask    = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+                d.srcAccessMask   = depth ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+                d.dstAccessMask   = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+                d.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+            }
+
+            if(!inputInfo.empty())
+            {
+                _queueSetWrite(NN.subpassInputSet, SUBPASS_INPUT_SET, inputInfo);
+            }
+        }
+
+        // subpasses between the one which writes an attachment and the
+        // last one which reads it need to preserve its contents
+        for(uint32_t a=0;a<writtenIn.size();a++)
+        {
+            for(auto sp = writtenIn[a]+1; sp < lastReadIn[a]; sp++)
+            {
+                auto & S = fb.m_subpasses[sp];
+                bool used = S.depthAttachment == static_cast<int32_t>(a) ||
+                            std::count(S.colorAttachments.begin(), S.colorAttachments.end(), a) ||
+                            std::count(S.resolveAttachments.begin(), S.resolveAttachments.end(), a) ||
+                            std::count(S.inputAttachments.begin(), S.inputAttachments.end(), a);
+                if(!used)
+                    S.preserveAttachments.push_back(a);
+            }
+        }
+    }
+
+    /**
+     * Sets the load/store ops of the attachments of the render pass made
+     * of m_execOrder[first..last) to the ones the graph derived. The
+     * attachments are the outputs of its passes in order. Transient
+     * targets are not stored either, they are only read in the render pass.
+     */
+    void _setAttachmentOps(FrameGraph const & G, size_t first, size_t last, uint32_t parity)
+    {
+        auto & passes  = G.getPasses();
+        auto & targets = G.getTargets();
+        auto & fb      = _nodes.at(_nodeName(G, m_execOrder[first], parity)).m_frameBuffer;
+
+        uint32_t a = 0;
+        for(size_t i=first;i<last;i++)
+        {
+            auto p        = m_execOrder[i];
+            auto outputs  = passes.getOutputs(p);
+            auto loadOps  = passes.getOutputLoadOps(p);
+            auto storeOps = passes.getOutputStoreOps(p);
+            for(uint32_t k=0;k<outputs.size();k++, a++)
+            {
+                auto & d     = fb.m_attachmentDesc[a];
+                bool   store = storeOps[k] == StoreOp::STORE && !targets.transient[outputs[k].index];
+
+                d.loadOp  = loadOps[k] == LoadOp::CLEAR ? VK_ATTACHMENT_LOAD_OP_CLEAR :
+                            loadOps[k] == LoadOp::LOAD  ? VK_ATTACHMENT_LOAD_OP_LOAD  : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                d.storeOp = store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+                bool stencil     = hasStencil(targets.format[outputs[k].index]);
+                d.stencilLoadOp  = stencil ? d.loadOp  : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                d.stencilStoreOp = stencil ? d.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            }
+        }
+    }
+
+    // Queues a write of the images to every frame in flight's copy of sets.
+    // The remaining array elements repeat the last image. The sets are
+    // allocated and written by _writeDescriptorSets( )
+    void _queueSetWrite(std::vector<VkDescriptorSet> & sets, SetKind kind, std::vector<VkDescriptorImageInfo> imageInfo)
+    {
+        while(imageInfo.size() < maxInputTextures)
+            imageInfo.push_back(imageInfo.back());
+
+        auto & W = m_setWrites.emplace_back();
+        W.sets      = &sets;
+        W.kind      = kind;
+        W.imageInfo = std::move(imageInfo);
+    }
+
+    /**
+     * Allocates the sets of the queued writes and writes all of them
+     * with a single vkUpdateDescriptorSets.
+     *
+     * Only the nodes rebuilt by resize( ) queue writes. The sets those
+     * nodes had are put back on the free lists first and handed out
+     * again. New sets are only allocated when the free lists run out,
+     * from a new pool sized for exactly the missing sets. The existing
+     * pools are never reset, the sets of the other nodes stay valid.
+     */
+    void _writeDescriptorSets()
+    {
+        for(auto & W : m_setWrites)
+        {
+            auto & free = m_setPools[W.kind].free;
+            free.insert(free.end(), W.sets->begin(), W.sets->end());
+            W.sets->clear();
+        }
+
+        uint32_t required[SET_KIND_COUNT] = {};
+        for(auto & W : m_setWrites)
+        {
+            required[W.kind] += m_framesInFlight;
+        }
+
+        uint32_t missing[SET_KIND_COUNT] = {};
+        for(uint32_t k=0;k<SET_KIND_COUNT;k++)
+        {
+            auto & S = m_setPools[k];
+            missing[k] = static_cast<uint32_t>(std::max<size_t>(required[k], S.free.size()) - S.free.size());
+        }
+        auto pool = _createDescriptorPool(missing);
+        if(pool != VK_NULL_HANDLE)
+        {
+            m_descriptorPools.push_back(pool);
+        }
+
+        for(uint32_t k=0;k<SET_KIND_COUNT;k++)
+        {
+            auto & S = m_setPools[k];
+            auto   n = missing[k];
+            if(n == 0)
+                continue;
+
+            std::vector<VkDescriptorSetLayout> layouts(n, S.layout);
+
+            VkDescriptorSetAllocateInfo allocInfo = {};
+            allocInfo.sType                       = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.descriptorSetCount          = n;
+            allocInfo.pSetLayouts                 = layouts.data();
+            allocInfo.descriptorPool              = pool;
+
+            S.free.resize(S.free.size() + n);
+            auto res = vkAllocateDescriptorSets(m_device, &allocInfo, S.free.data() + S.free.size() - n);
+            if (res != VK_SUCCESS)
+            {
+                std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+                assert(res == VK_SUCCESS);
+            }
+            S.allocated += n;
+        }
+
+        std::vector<VkWriteDescriptorSet> writes;
+        writes.reserve(m_setWrites.size() * m_framesInFlight);
+        for(auto & W : m_setWrites)
+        {
+            auto & S = m_setPools[W.kind];
+            for(uint32_t f=0;f<m_framesInFlight;f++)
+            {
+                W.sets->push_back(S.free.back());
+                S.free.pop_back();
+
+                auto & write = writes.emplace_back();
+                write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write.pImageInfo      = W.imageInfo.data();
+                write.descriptorCount = static_cast<uint32_t>(W.imageInfo.size());
+                write.dstArrayElement = 0;
+                write.dstSet          = W.sets->back();
+                write.descriptorType  = S.type;
+            }
+        }
+
+        if(writes.size())
+        {
+            vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        }
+        GFG_INFO("Descriptor sets updated: {}", writes.size());
+        m_stats.descriptorSetsWritten += static_cast<uint32_t>(writes.size());
+        m_setWrites.clear();
+    }
+
+    static VkImageAspectFlags _aspectMask(VkFormat format)
+    {
+        switch(format)
+        {
+            case VK_FORMAT_D16_UNORM:
+            case VK_FORMAT_D32_SFLOAT:
+                return VK_IMAGE_ASPECT_DEPTH_BIT;
+            case VK_FORMAT_D16_UNORM_S8_UINT:
+            case VK_FORMAT_D24_UNORM_S8_UINT:
+            case VK_FORMAT_D32_SFLOAT_S8_UINT:
+                return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+            default:
+                return VK_IMAGE_ASPECT_COLOR_BIT;
+        }
+    }
+
+    /**
+     * Works out the image and buffer barriers each pass needs from the graph's
+     * read/write edges. The layout, stage and access of every image
+     * is tracked through the execution order:
+     *
+     *   - An output is transitioned from UNDEFINED into the attachment
+     *     layout, after the previous reads/writes of the image finish.
+     *     Outputs which are loaded keep their contents and layout.
+     *   - An input is transitioned into SHADER_READ_ONLY after the
+     *     attachment writes. If it is already readable, eg: it was
+     *     read by an earlier pass, no barrier is needed.
+     *   - Images written or read as storage images by compute passes
+     *     are in the GENERAL layout.
+     *   - Buffers have no layout. A buffer barrier is needed before a
+     *     pass writes a buffer and before a pass reads a buffer which
+     *     has been written since it was last read.
+     *   - Input attachments of merged passes are handled by the
+     *     render pass. The barriers of the merged passes are all
+     *     recorded before the render pass begins.
+     *   - With async compute, stages and writes are tracked for each
+     *     queue. Accesses on the other queue are ordered and made
+     *     visible by the timeline semaphore between the batches, so
+     *     a barrier only waits for accesses on its own queue.
+     *
+     * The execution order is walked twice so that the first passes
+     * wait on how the previous frame left the images.
+     */
+    void _buildBarriers(FrameGraph const & G, uint32_t parity)
+    {
+        auto & passes      = G.getPasses();
+        auto & targets     = G.getTargets();
+        auto & images      = G.getImages();
+        auto & buffers     = G.getBuffers();
+        auto & bufferTable = G.getBufferTable();
+
+        // stage and access are indexed by queue. A stage of 0 means the
+        // last access was on the other queue.
+        struct ImageState
+        {
+            VkImageLayout        layout    = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkPipelineStageFlags stage[2]  = {VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT};
+            VkAccessFlags        access[2] = {0, 0}; // writes which need to be made available
+        };
+        struct BufferState
+        {
+            VkPipelineStageFlags stage[2]  = {VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT};
+            VkAccessFlags        access[2] = {0, 0}; // writes which need to be made available
+        };
+        // each mip level of an image has its own state, the
+        // levels of image k are state[ stateOffset[k] .. stateOffset[k+1] )
+        std::vector<uint32_t> stateOffset(images.size() + 1, 0);
+        for(uint32_t k=0;k<images.size();k++)
+        {
+            stateOffset[k+1] = stateOffset[k] + images[k].mipLevels;
+        }
+        std::vector<ImageState>  state(stateOffset.back());
+        std::vector<BufferState> bufferState(buffers.size());
+
+        for(uint32_t iteration=0; iteration<2; iteration++)
+        {
+            m_barriers.clear();
+            m_bufferBarriers.clear();
+
+            // the previous frame had the other parity
+            auto framePar = iteration == 0 ? 1 - parity : parity;
+
+            // imported images are in the application's layout when the frame starts
+            for(uint32_t k=0;k<images.size();k++)
+            {
+                if(!images[k].imported)
+                    continue;
+                auto & S = state[stateOffset[k]];
+                S.layout    = _imports.at(images[k].name).layout;
+                S.stage[0]  = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+                S.access[0] = VK_ACCESS_MEMORY_WRITE_BIT;
+            }
+
+            for(uint32_t i=0;i<m_plan.size();i++)
+            {
+                auto   p = m_execOrder[i];
+
+                // barriers can't be recorded inside a render pass so the
+                // barriers of merged passes are recorded before the first one
+                auto & P = m_plan[i - passes.subpass[p.index]];
+
+                m_plan[i].barrierCount       = 0;
+                m_plan[i].bufferBarrierCount = 0;
+                if(passes.subpass[p.index] == 0)
+                {
+                    P.barrierOffset       = static_cast<uint32_t>(m_barriers.size());
+                    P.bufferBarrierOffset = static_cast<uint32_t>(m_bufferBarriers.size());
+                    P.srcStageMask        = 0;
+                    P.dstStageMask        = 0;
+                }
+
+                uint32_t q = m_plan[i].asyncCompute ? 1 : 0;
+                uint32_t o = 1 - q;
+
+                // a write or layout transition on this queue. The other queue
+                // waits for it with a semaphore before its next access.
+                auto _access = [&](auto & S, VkPipelineStageFlags stage, VkAccessFlags write)
+                {
+                    S.stage[q]  = stage;
+                    S.access[q] = write;
+                    S.stage[o]  = 0;
+                    S.access[o] = 0;
+                };
+
+                auto _barrier = [&](ImageHandle h, uint32_t mip, VkImageLayout newLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+                {
+                    auto & S   = state[stateOffset[h.index] + mip];
+                    auto & img = _images.at(images[h.index].name);
+
+                    auto & b = m_barriers.emplace_back();
+                    b.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                    b.srcAccessMask       = S.access[q];
+                    b.dstAccessMask       = dstAccess;
+                    b.oldLayout           = S.layout;
+                    b.newLayout           = newLayout;
+                    b.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    b.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    b.image               = img.image;
+                    b.subresourceRange    = { _aspectMask(img.info.format), 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+                    if(images[h.index].mipLevels > 1)
+                    {
+                        b.subresourceRange.baseMipLevel = mip;
+                        b.subresourceRange.levelCount   = 1;
+                    }
+
+                    // after a semaphore wait, the barrier only has to
+                    // chain with the wait's stages
+                    P.srcStageMask |= S.stage[q] ? S.stage[q] : dstStage;
+                    P.dstStageMask |= dstStage;
+                    return &b;
+                };
+
+                bool                 compute     = passes.type[p.index] == PassType::COMPUTE;
+                VkPipelineStageFlags shaderStage = compute ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+                // a read in the given layout by the shaders of the pass
+                auto _read = [&](ImageHandle h, uint32_t mip, VkImageLayout layout)
+                {
+                    auto & S = state[stateOffset[h.index] + mip];
+                    if(S.layout == layout && S.access[q] == 0)
+                    {
+                        // read after read
+                        S.stage[q] |= shaderStage;
+                        return;
+                    }
+
+                    _barrier(h, mip, layout, shaderStage, VK_ACCESS_SHADER_READ_BIT);
+
+                    // a layout transition is a write, so the
+                    // other queue can't keep reading the image
+                    if(S.layout != layout)
+                        _access(S, shaderStage, 0);
+                    S.layout    = layout;
+                    S.stage[q]  = shaderStage;
+                    S.access[q] = 0;
+                };
+
+                auto loadOps = passes.getOutputLoadOps(p);
+                for(uint32_t k=0;k<loadOps.size();k++)
+                {
+                    auto   t     = passes.getOutputs(p)[k];
+                    auto   h     = targets.getImage(t, framePar);
+                    auto   mip   = targets.mip[t.index];
+                    bool   depth = isDepth(targets.format[t.index]);
+                    auto & S     = state[stateOffset[h.index] + mip];
+
+                    if(compute)
+                    {
+                        // storage image outputs are written by the whole dispatch
+                        _barrier(h, mip, VK_IMAGE_LAYOUT_GENERAL, shaderStage, VK_ACCESS_SHADER_WRITE_BIT)->oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+                        S.layout = VK_IMAGE_LAYOUT_GENERAL;
+                        _access(S, shaderStage, VK_ACCESS_SHADER_WRITE_BIT);
+                        continue;
+                    }
+
+                    VkImageLayout        layout = depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+                    VkPipelineStageFlags stage = depth ? VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+                                                       : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+                    VkAccessFlags        write = depth ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+                    VkAccessFlags        read  = depth ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT : VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+
+                    // unless the output is loaded, the old contents can be discarded
+                    auto b = _barrier(h, mip, layout, stage, read | write);
+                    if(loadOps[k] != LoadOp::LOAD)
+                        b->oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+                    S.layout = layout;
+                    _access(S, stage, write);
+                }
+
+                auto subpassInputs = passes.getSubpassInputs(p);
+                auto inputTypes    = passes.getInputTypes(p);
+                for(uint32_t k=0;k<subpassInputs.size();k++)
+                {
+                    // input attachments are synchronized by the
+                    // subpass dependencies of the render pass
+                    if(subpassInputs[k])
+                        continue;
+
+                    auto t = passes.getInputs(p)[k];
+                    _read(targets.getImage(t, framePar), targets.mip[t.index], inputTypes[k] == InputType::STORAGE ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+                }
+
+                // the history is the image written in the previous frame
+                for(auto t : passes.getHistoryInputs(p))
+                {
+                    _read(targets.getImage(t, 1 - framePar), 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+                }
+
+                auto _bufferBarrier = [&](BufferHandle b, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+                {
+                    auto & S   = bufferState[bufferTable.allocation[b.index].index];
+                    auto & buf = _buffers.at(buffers[bufferTable.allocation[b.index].index].name);
+
+                    auto & bb = m_bufferBarriers.emplace_back();
+                    bb.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                    bb.srcAccessMask       = S.access[q];
+                    bb.dstAccessMask       = dstAccess;
+                    bb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    bb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    bb.buffer              = buf.buffer;
+                    bb.offset              = 0;
+                    bb.size                = VK_WHOLE_SIZE;
+
+                    P.srcStageMask |= S.stage[q] ? S.stage[q] : dstStage;
+                    P.dstStageMask |= dstStage;
+                };
+
+                VkPipelineStageFlags bufferStage = compute ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+                for(auto b : passes.getInputBuffers(p))
+                {
+                    auto & S = bufferState[bufferTable.allocation[b.index].index];
+
+                    VkPipelineStageFlags stage  = 0;
+                    VkAccessFlags        access = 0;
+                    _bufferReadAccess(bufferTable.usage[b.index], bufferStage, stage, access);
+
+                    if(S.access[q] == 0)
+                    {
+                        // read after read
+                        S.stage[q] |= stage;
+                        continue;
+                    }
+
+                    _bufferBarrier(b, stage, access);
+
+                    S.stage[q]  = stage;
+                    S.access[q] = 0;
+                }
+                for(auto b : passes.getOutputBuffers(p))
+                {
+                    auto & S = bufferState[bufferTable.allocation[b.index].index];
+
+                    // wait for the previous reads and writes of the buffer
+                    _bufferBarrier(b, bufferStage, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+                    _access(S, bufferStage, VK_ACCESS_SHADER_WRITE_BIT);
+                }
+
+                P.barrierCount       = static_cast<uint32_t>(m_barriers.size()) - P.barrierOffset;
+                P.bufferBarrierCount = static_cast<uint32_t>(m_bufferBarriers.size()) - P.bufferBarrierOffset;
+            }
+
+            // imported images are returned to the application's layout
+            auto & E = m_endOfFrame;
+            E = {};
+            E.barrierOffset = static_cast<uint32_t>(m_barriers.size());
+            for(uint32_t k=0;k<images.size();k++)
+            {
+                if(!images[k].imported)
+                    continue;
+                auto & S      = state[stateOffset[k]];
+                auto   layout = _imports.at(images[k].name).layout;
+                if(layout == VK_IMAGE_LAYOUT_UNDEFINED || (S.layout == layout && S.access[0] == 0))
+                    continue;
+
+                auto & img = _images.at(images[k].name);
+                auto & b   = m_barriers.emplace_back();
+                b.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                b.srcAccessMask       = S.access[0];
+                b.dstAccessMask       = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+                b.oldLayout           = S.layout;
+                b.newLayout           = layout;
+                b.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                b.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                b.image               = img.image;
+                b.subresourceRange    = { _aspectMask(img.info.format), 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+
+                E.srcStageMask |= S.stage[0];
+                E.dstStageMask  = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            }
+            E.barrierCount = static_cast<uint32_t>(m_barriers.size()) - E.barrierOffset;
+        }
+    }
+
+    // The stages and accesses a pass reads a buffer with, based on
+    // how the buffer was declared. shaderStage are the shader stages
+    // of the pass.
+    static void _bufferReadAccess(BufferUsage usage, VkPipelineStageFlags shaderStage, VkPipelineStageFlags & stage, VkAccessFlags & access)
+    {
+        if( hasUsage(usage, BufferUsage::STORAGE) )
+        {
+            stage  |= shaderStage;
+            access |= VK_ACCESS_SHADER_READ_BIT;
+        }
+        if( hasUsage(usage, BufferUsage::UNIFORM) )
+        {
+            stage  |= shaderStage;
+            access |= VK_ACCESS_UNIFORM_READ_BIT;
+        }
+        if( hasUsage(usage, BufferUsage::INDIRECT) )
+        {
+            stage  |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+            access |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        }
+        // compute passes can only read vertex and index buffers from
+        // shaders, and the compute queue has no vertex input stage
+        bool                 compute     = shaderStage == VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        VkPipelineStageFlags vertexStage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+        if( compute )
+            vertexStage = shaderStage;
+        if( hasUsage(usage, BufferUsage::VERTEX) )
+        {
+            stage  |= vertexStage;
+            access |= compute ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+        }
+        if( hasUsage(usage, BufferUsage::INDEX) )
+        {
+            stage  |= vertexStage;
+            access |= compute ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_INDEX_READ_BIT;
+        }
+    }
+
+    // Records the precomputed image and buffer barriers for the pass as a single batch
+    void _recordBarriers(VkCommandBuffer cmd, PassRecord const & P)
+    {
+        if(P.barrierCount == 0 && P.bufferBarrierCount == 0)
+            return;
+
+        vkCmdPipelineBarrier(cmd,
+                P.srcStageMask,
+                P.dstStageMask,
+                0,
+                0, nullptr,
+                P.bufferBarrierCount, m_bufferBarriers.data() + P.bufferBarrierOffset,
+                P.barrierCount, m_barriers.data() + P.barrierOffset);
+    }
+
+    // Copies the prebuilt frame of the pass into F and fills in the
+    // values which come from the swapchain and the resolution scale.
+    void _prepareFrame(Frame & F, PassRecord const & P, RenderInfo const & Ri, uint32_t frameIndex) const
+    {
+        _copyFrame(F, P.frame, &Frame::inputAttachments, &Frame::clearValue, &Frame::inputBuffers, &Frame::outputBuffers);
+
+        auto & R = P.frames[frameIndex];
+        F.inputAttachmentSet = R.inputAttachmentSet;
+        F.subpassInputSet    = R.subpassInputSet;
+        F.storageImageSet    = R.storageImageSet;
+
+        F.windowWidth    = Ri.swapchainWidth;
+        F.windowHeight   = Ri.swapchainHeight;
+
+        // the resolution scale can change every frame
+        if( F.resizable )
+        {
+            _renderableExtent(P.scale, F.imageWidth, F.imageHeight, F.renderableWidth, F.renderableHeight);
+        }
+
+        if( P.toSwapchain )
+        {
+            // the prebuilt frame has a color and a depth clear value
+            if(Ri.swapchainDepthImage == VK_NULL_HANDLE)
+            {
+                F.clearValue.pop_back();
+            }
+
+            F.frameBuffer        = Ri.swapchainFrameBuffer;
+            F.renderPass         = Ri.swapchainRenderPass;
+            F.imageWidth         = Ri.swapchainWidth;
+            F.imageHeight        = Ri.swapchainHeight;
+            F.renderableWidth    = Ri.swapchainWidth;
+            F.renderableHeight   = Ri.swapchainHeight;
+        }
+    }
+
+    // Records every pass of the current level which
+    // belongs to worker w into its secondary command buffer
+    void _recordLevel(uint32_t w)
+    {
+        auto & F  = m_workers[w].frame;
+        auto & Ri = *m_recordInfo;
+
+        for(auto i = m_levelOffset[m_recordLevel]; i < m_levelOffset[m_recordLevel+1]; i++)
+        {
+            auto & P = m_plan[m_levelPasses[i]];
+            if(P.worker != w)
+                continue;
+
+            _prepareFrame(F, P, Ri, m_frameIndex);
+
+            // compute passes are recorded outside of a render pass
+            auto & inh       = P.inheritanceInfo;
+            inh.sType        = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inh.renderPass   = F.isCompute ? VK_NULL_HANDLE : F.renderPass;
+            inh.subpass      = F.subpass;
+            inh.framebuffer  = F.isCompute ? VK_NULL_HANDLE : F.frameBuffer;
+
+            VkCommandBufferBeginInfo bi = {};
+            bi.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            bi.flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            if(!F.isCompute)
+                bi.flags       |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            bi.pInheritanceInfo = &inh;
+
+            auto cmd = P.frames[m_frameIndex].secondaryBuffer;
+            vkBeginCommandBuffer(cmd, &bi);
+
+            F.commandBuffer   = cmd;
+            F.isSecondary     = true;
+            F.inheritanceInfo = &inh;
+
+            // the primary can't write timestamps inside a render pass
+            // whose contents are secondary command buffers
+            _writeTimestamp(cmd, m_levelPasses[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+            (*P.renderer)(F);
+            _writeTimestamp(cmd, m_levelPasses[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+            vkEndCommandBuffer(cmd);
+
+            // the renderer may have changed the clear values, these
+            // are used when the primary begins the render pass
+            P.clearValues = F.clearValue;
+        }
+    }
+
+    // Records all the passes in parallel, one dependency level at a time,
+    // then executes the secondary command buffers in the plan's order.
+    void _executeParallel(RenderInfo const & Ri)
+    {
+        m_recordInfo = &Ri;
+        for(m_recordLevel = 0; m_recordLevel + 1 < m_levelOffset.size(); m_recordLevel++)
+        {
+            m_workerPool.run(m_recordJob);
+        }
+        m_recordInfo = nullptr;
+
+        auto & F = m_frame;
+        for(uint32_t i=0;i<m_plan.size();i++)
+        {
+            auto & P   = m_plan[i];
+            auto   cmd = _commandBuffer(P, Ri);
+            _prepareFrame(F, P, Ri, m_frameIndex);
+
+            if(P.aliasingBarrier)
+            {
+                _aliasingBarrier(cmd);
+            }
+            _recordBarriers(cmd, P);
+            _resetTimestamps(cmd, i, P);
+
+            if(P.worker == PassRecord::noWorker)
+            {
+                F.commandBuffer = cmd;
+                _writeTimestamp(cmd, i, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+                (*P.renderer)(F);
+                _writeTimestamp(cmd, i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+                continue;
+            }
+            if(F.isCompute)
+            {
+                vkCmdExecuteCommands(cmd, 1, &P.frames[m_frameIndex].secondaryBuffer);
+                continue;
+            }
+
+            if(F.subpass == 0)
+            {
+                VkRenderPassBeginInfo render_pass_info = {};
+                render_pass_info.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+                render_pass_info.pNext             = F.attachmentBeginInfo;
+                render_pass_info.renderPass        = F.renderPass;
+                render_pass_info.framebuffer       = F.frameBuffer;
+                render_pass_info.renderArea.offset = {0, 0};
+                render_pass_info.renderArea.extent = {F.renderableWidth, F.renderableHeight};
+                render_pass_info.clearValueCount   = static_cast<uint32_t>(P.clearValues.size());
+                render_pass_info.pClearValues      = P.clearValues.data();
+
+                vkCmdBeginRenderPass(cmd, &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            }
+            else
+            {
+                vkCmdNextSubpass(cmd, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            }
+            vkCmdExecuteCommands(cmd, 1, &P.frames[m_frameIndex].secondaryBuffer);
+            if(F.lastSubpass)
+            {
+                vkCmdEndRenderPass(cmd);
+            }
+        }
+    }
+
+    // Gives every frame index a query pool with a begin and an end
+    // timestamp for each pass. Timestamps written with the previous
+    // plan are never read back.
+    void _buildQueryPools()
+    {
+        for(auto & Q : m_queryFrames)
+        {
+            Q.recorded = 0;
+        }
+        if(!m_profiling)
+            return;
+
+        auto passCount = static_cast<uint32_t>(m_plan.size());
+        if(passCount <= m_queryCapacity && m_queryFrames.size() == m_framesInFlight)
+            return;
+
+        for(auto & Q : m_queryFrames)
+        {
+            vkDestroyQueryPool(m_device, Q.pool, nullptr);
+        }
+        m_queryFrames.resize(m_framesInFlight);
+        m_queryCapacity = passCount;
+        m_queryResults.reserve(size_t(passCount) * 4);
+
+        VkQueryPoolCreateInfo ci = {};
+        ci.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        ci.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+        ci.queryCount = std::max(2 * passCount, 1u);
+        for(auto & Q : m_queryFrames)
+        {
+            auto res = vkCreateQueryPool(m_device, &ci, nullptr, &Q.pool);
+            if (res != VK_SUCCESS)
+            {
+                std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+                assert(res == VK_SUCCESS);
+            }
+        }
+    }
+
+    // Reads back the timestamps written the last time this frame index
+    // was used. The application has waited for that frame, but results
+    // which are not available yet are skipped rather than waited for.
+    void _readTimestamps()
+    {
+        auto & Q = m_queryFrames[m_frameIndex];
+        if(Q.recorded)
+        {
+            // begin, availability, end, availability for each pass
+            m_queryResults.resize(size_t(Q.recorded) * 4);
+            vkGetQueryPoolResults(m_device, Q.pool, 0, 2 * Q.recorded,
+                                  m_queryResults.size() * sizeof(uint64_t), m_queryResults.data(),
+                                  2 * sizeof(uint64_t),
+                                  VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+            for(uint32_t i=0;i<Q.recorded;i++)
+            {
+                auto * r = &m_queryResults[size_t(i) * 4];
+                if(r[1] && r[3] && r[2] >= r[0])
+                {
+                    _addTiming(i, static_cast<double>(r[2] - r[0]) * m_timestampPeriod * 1e-6);
+                }
+            }
+        }
+        Q.recorded = static_cast<uint32_t>(m_plan.size());
+    }
 
+    // Resets the timestamps of the pass, and of the passes merged into
+    // its render pass, before they are written this frame
+    void _resetTimestamps(VkCommandBuffer cmd, uint32_t i, PassRecord const & P) const
+    {
+        if(m_profiling && P.timestampCount)
+        {
+            vkCmdResetQueryPool(cmd, m_queryFrames[m_frameIndex].pool, 2 * i, P.timestampCount);
+        }
+    }
 
-    /**
-     * @brief operator ()
-     * @param G
-     * @param Ri
-     *
-     * Call the framegraph to execute the render functions.
-     *
-     * The RenderInfo struct needs to be filled in. This contains
-     * information about the current swapchain Image that you are rendering
-     * to.
-     *
-     * The swapchain is not managed by teh FrameGraph as it should be
-     * managed by your window manager or your main loop.
-     *
-     */
-    void operator()(FrameGraph const & G, RenderInfo const & Ri)
+    // Writes the begin (TOP_OF_PIPE) or end (BOTTOM_OF_PIPE) timestamp of the i-th pass
+    void _writeTimestamp(VkCommandBuffer cmd, uint32_t i, VkPipelineStageFlagBits stage) const
     {
-        for(auto & x : m_execOrder)
+        if(m_profiling)
         {
-            auto & N = G.getNodes().at(x);
-            if( std::holds_alternative<RenderPassNode>(N))
-            {
-                auto &R = _renderers.at(x);
-                Frame F;
-                auto &NN  = _nodes.at(x);
-                auto &RPN = std::get<RenderPassNode>(N);
+            auto query = 2 * i + (stage == VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT ? 1 : 0);
+            vkCmdWriteTimestamp(cmd, stage, m_queryFrames[m_frameIndex].pool, query);
+        }
+    }
 
-                F.windowWidth    = Ri.swapchainWidth;
-                F.windowHeight   = Ri.swapchainHeight;
+    // The primary command buffer the pass is recorded into
+    VkCommandBuffer _commandBuffer(PassRecord const & P, RenderInfo const & Ri) const
+    {
+        return m_batches.empty() ? Ri.commandBuffer : m_batches[P.batch].commandBuffer;
+    }
 
-                // There are output render targets
-                // this means we are not rendering to a
-                // swapchain.
-                if( RPN.outputRenderTargets.size())
-                {
-                    for(auto & f : RPN.outputRenderTargets)
-                    {
-                        auto &cv = F.clearValue.emplace_back();
-                        if( !isDepth(f.format) )
-                        {
-                            cv.color.float32[0] = 0.0f;
-                            cv.color.float32[1] = 0.0f;
-                            cv.color.float32[2] = 0.0f;
-                            cv.color.float32[3] = 0.0f;
-                        }
-                        else
-                        {
-                            cv.depthStencil.stencil = 0;
-                            cv.depthStencil.depth = 1.0f;
-                        }
-
-                        auto &GN           = G.getNodes();
-                        auto &rtn          = GN.at(f.name);
-                        auto &v            = std::get<RenderTargetNode>(rtn);
-                        auto  extent       = _images.at(v.imageResource.name).info.extent;
-                        F.imageWidth       = extent.width;
-                        F.imageHeight      = extent.height;
-                        F.renderableWidth  = extent.width;
-                        F.renderableHeight = extent.height;
-                    }
+    // The number of queue families an image or buffer has to be shared
+    // between. Only resources used by the compute queue are shared.
+    uint32_t _sharedFamilyCount(bool asyncCompute) const
+    {
+        bool shared = asyncCompute && m_queues[1].queue != VK_NULL_HANDLE && m_queueFamilies[0] != m_queueFamilies[1];
+        return shared ? 2 : 0;
+    }
 
-                    F.commandBuffer    = Ri.commandBuffer;
-                    F.frameBuffer      = NN.m_frameBuffer.frameBuffer;
-                    F.renderPass       = NN.m_frameBuffer.renderPass;
-                    F.inputAttachments = NN.m_frameBuffer.attachments;
-                    //F.imageWidth       = NN.width;
-                    //F.imageHeight      = NN.height;
-                    F.inputAttachmentSet = NN.descriptorSet;
+    // Copies the queue batches of the graph when async compute is enabled
+    // and gives every batch, except the last graphics batch, a primary
+    // command buffer from its queue's pool. If no pass is on the compute
+    // queue, m_batches is left empty and everything is recorded into
+    // RenderInfo::commandBuffer as usual.
+    void _buildBatches(FrameGraph const & G)
+    {
+        auto & passes  = G.getPasses();
+        auto & batches = G.getQueueBatches();
 
-                    F.inputAttachmentSetLayout = NN.inputAttachments.size() == 0 ? VK_NULL_HANDLE : m_dsetLayout;
+        m_batches.clear();
+        m_userBatch  = QueueBatch::noWait;
+        m_submitInfo = {};
+        for(auto & P : m_plan)
+        {
+            P.asyncCompute = false;
+            P.batch        = 0;
+        }
 
-                    //F.renderableWidth       = NN.width;
-                    //F.renderableHeight      = NN.height;
-                }
-                else
-                {
-                    F.clearValue.emplace_back();
-                    if(Ri.swapchainDepthImage != VK_NULL_HANDLE)
-                    {
-                        auto & cv = F.clearValue.emplace_back();
-                        cv.depthStencil.stencil = 0;
-                        cv.depthStencil.depth = 1.0f;
-                    }
+        bool async = false;
+        for(auto & B : batches)
+        {
+            async |= B.queue == QueueType::COMPUTE;
+        }
+        if(m_queues[1].queue == VK_NULL_HANDLE || !async)
+            return;
 
-                    F.commandBuffer      = Ri.commandBuffer;
-                    F.frameBuffer        = Ri.swapchainFrameBuffer;
-                    F.renderPass         = Ri.swapchainRenderPass;
-                    F.inputAttachments   = NN.inputAttachments;
-                    F.imageWidth         = Ri.swapchainWidth;
-                    F.imageHeight        = Ri.swapchainHeight;
-                    F.renderableWidth    = Ri.swapchainWidth;
-                    F.renderableHeight   = Ri.swapchainHeight;
-                    F.inputAttachmentSet = NN.descriptorSet;
-                    F.inputAttachmentSetLayout = NN.inputAttachments.size() == 0 ? VK_NULL_HANDLE : m_dsetLayout;
-                }
+        for(uint32_t b=0;b<batches.size();b++)
+        {
+            auto & B = batches[b];
+            auto & R = m_batches.emplace_back();
+            R.queue             = static_cast<uint32_t>(B.queue);
+            R.signalOffset      = B.indexInQueue + 1;
+            R.waitOffset        = B.wait == QueueBatch::noWait ? 0 : batches[B.wait].indexInQueue + 1;
+            R.waitPreviousFrame = B.waitPreviousFrame;
+
+            if(B.queue == QueueType::GRAPHICS)
+                m_userBatch = b;
+        }
 
-                R(F);
+        for(auto & Q : m_queues)
+        {
+            Q.batchCount = 0;
+        }
+        for(uint32_t b=0;b<m_batches.size();b++)
+        {
+            auto & R = m_batches[b];
+            auto & Q = m_queues[R.queue];
+            R.indexInQueue = Q.batchCount++;
+            if(b == m_userBatch)
+                continue;
+
+            for(auto & F : Q.frames)
+            {
+                if(R.indexInQueue < F.commandBuffers.size())
+                    continue;
+
+                VkCommandBufferAllocateInfo ai = {};
+                ai.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                ai.commandPool        = F.commandPool;
+                ai.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+                ai.commandBufferCount = 1;
+
+                auto & cmd = F.commandBuffers.emplace_back();
+                auto res = vkAllocateCommandBuffers(m_device, &ai, &cmd);
+                if (res != VK_SUCCESS)
+                {
+                    std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+                    assert(res == VK_SUCCESS);
+                }
             }
         }
+
+        for(uint32_t i=0;i<m_plan.size();i++)
+        {
+            auto p = m_execOrder[i];
+            auto & P = m_plan[i];
+            P.batch        = passes.batch[p.index];
+            P.asyncCompute = passes.queue[p.index] == QueueType::COMPUTE;
+
+            // the swapchain image is only available to the user's submit
+            assert(!P.toSwapchain || P.batch == m_userBatch);
+        }
     }
 
-protected:
-    struct VKNodeInfo
+    // Waits for the batches operator() submitted the last time this frame
+    // index was used so their command buffers can be reused, then begins
+    // recording.
+    void _beginBatches(RenderInfo const & Ri)
     {
-        // the images that the render pass will
-        // sample from
-        std::vector<VkImageView> inputAttachments;
-
-        bool                     isInit = false;
+        VkSemaphore semaphores[2];
+        uint64_t    values[2];
+        uint32_t    count = 0;
+        for(auto & Q : m_queues)
+        {
+            auto & F = Q.frames[m_frameIndex];
+            if(F.submitted == 0)
+                continue;
+            semaphores[count] = Q.timeline;
+            values[count]     = F.submitted;
+            count++;
+        }
+        if(count)
+        {
+            VkSemaphoreWaitInfo wi = {};
+            wi.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+            wi.semaphoreCount = count;
+            wi.pSemaphores    = semaphores;
+            wi.pValues        = values;
+            vkWaitSemaphores(m_device, &wi, std::numeric_limits<uint64_t>::max());
+        }
 
-        VkDescriptorPool         descriptorPool = VK_NULL_HANDLE;
-        VkDescriptorSet          descriptorSet = VK_NULL_HANDLE;
+        for(auto & Q : m_queues)
+        {
+            vkResetCommandPool(m_device, Q.frames[m_frameIndex].commandPool, 0);
+        }
 
-        FrameBuffer m_frameBuffer;
-    };
+        VkCommandBufferBeginInfo bi = {};
+        bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        for(uint32_t b=0;b<m_batches.size();b++)
+        {
+            auto & B = m_batches[b];
+            if(b == m_userBatch)
+            {
+                B.commandBuffer = Ri.commandBuffer;
+                continue;
+            }
+            B.commandBuffer = m_queues[B.queue].frames[m_frameIndex].commandBuffers[B.indexInQueue];
+            vkBeginCommandBuffer(B.commandBuffer, &bi);
+        }
+    }
 
-    struct VKImageInfo
+    // Submits every batch except the one recorded into RenderInfo::commandBuffer,
+    // in the graph's order. The n-th batch of a queue in a frame signals the
+    // queue's timeline with the value of the previous frame plus n+1.
+    void _submitBatches()
     {
-        VkImage     image     = VK_NULL_HANDLE;
-        VkImageView imageView = VK_NULL_HANDLE;
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
 
-        uint32_t   width     = 0;
-        uint32_t   height    = 0;
+        for(uint32_t b=0;b<m_batches.size();b++)
+        {
+            auto & B = m_batches[b];
+            auto & Q = m_queues[B.queue];
+            auto & O = m_queues[1 - B.queue];
 
-        bool       resizable = true;
+            uint64_t waitValue   = O.value + B.waitOffset;
+            uint64_t signalValue = Q.value + B.signalOffset;
+            uint32_t waitCount   = (B.waitOffset || B.waitPreviousFrame) && waitValue > 0 ? 1 : 0;
 
-        VkImageCreateInfo info       = {};
-        VmaAllocation     allocation = {};
-        VmaAllocationInfo allocInfo  = {};
-        VkImageViewType   viewType   = {};
+            if(b == m_userBatch)
+            {
+                m_submitInfo.waitSemaphore   = waitCount ? O.timeline : VK_NULL_HANDLE;
+                m_submitInfo.waitValue       = waitValue;
+                m_submitInfo.signalSemaphore = Q.timeline;
+                m_submitInfo.signalValue     = signalValue;
+                continue;
+            }
 
-        VkSampler linearSampler  = {};
-        VkSampler nearestSampler = {};
+            vkEndCommandBuffer(B.commandBuffer);
+
+            VkTimelineSemaphoreSubmitInfo ti = {};
+            ti.sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            ti.waitSemaphoreValueCount   = waitCount;
+            ti.pWaitSemaphoreValues      = &waitValue;
+            ti.signalSemaphoreValueCount = 1;
+            ti.pSignalSemaphoreValues    = &signalValue;
+
+            VkSubmitInfo si = {};
+            si.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            si.pNext                = &ti;
+            si.waitSemaphoreCount   = waitCount;
+            si.pWaitSemaphores      = &O.timeline;
+            si.pWaitDstStageMask    = &waitStage;
+            si.commandBufferCount   = 1;
+            si.pCommandBuffers      = &B.commandBuffer;
+            si.signalSemaphoreCount = 1;
+            si.pSignalSemaphores    = &Q.timeline;
+
+            auto res = vkQueueSubmit(Q.queue, 1, &si, VK_NULL_HANDLE);
+            if (res != VK_SUCCESS)
+            {
+                std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+                assert(res == VK_SUCCESS);
+            }
+            Q.frames[m_frameIndex].submitted = signalValue;
+        }
 
-        std::vector<VkDescriptorImageInfo> _imageInfo; // for writes
-    };
+        for(auto & Q : m_queues)
+        {
+            Q.value += Q.batchCount;
+        }
+    }
 
-    void _destroyImage(VKImageInfo &img)
+    int32_t _createTransientHeap(VkMemoryRequirements const & requirements)
     {
-        if(img.imageView)
-            vkDestroyImageView(m_device, img.imageView, nullptr);
-        if(img.image)
-            vmaDestroyImage(m_allocator, img.image, img.allocation);
-        if(img.linearSampler)
-            vkDestroySampler(m_device, img.linearSampler, nullptr);
-        if(img.nearestSampler)
-            vkDestroySampler(m_device, img.nearestSampler, nullptr);
+        VmaAllocationCreateInfo allocCInfo = {};
+        allocCInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
-        img.imageView      = VK_NULL_HANDLE;
-        img.image          = VK_NULL_HANDLE;
-        img.linearSampler  = VK_NULL_HANDLE;
-        img.nearestSampler = VK_NULL_HANDLE;
+        TransientHeap heap;
+        {
+            auto res = vmaAllocateMemory(m_allocator, &requirements, &allocCInfo, &heap.allocation, &heap.allocInfo);
+            if (res != VK_SUCCESS)
+            {
+                std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+                assert(res == VK_SUCCESS);
+            }
+        }
+
+        // reuse a slot from a heap which has been freed
+        for(size_t i=0;i<m_transientHeaps.size();i++)
+        {
+            if(m_transientHeaps[i].allocation == VK_NULL_HANDLE)
+            {
+                m_transientHeaps[i] = heap;
+                return static_cast<int32_t>(i);
+            }
+        }
+        m_transientHeaps.push_back(heap);
+        return static_cast<int32_t>(m_transientHeaps.size()-1);
+    }
+
+    // Make sure all previous attachment writes and shader reads have
+    // completed before an image which shares their memory is written to.
+    static void _aliasingBarrier(VkCommandBuffer cmd)
+    {
+        VkMemoryBarrier barrier = {};
+        barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(cmd,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0,
+                1, &barrier,
+                0, nullptr,
+                0, nullptr);
     }
 
     void _createDescriptorSetLayout()
@@ -658,11 +3117,25 @@ protected:
         if(m_dsetLayout != VK_NULL_HANDLE)
             return;
 
+        m_dsetLayout         = _createDescriptorSetLayout(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+        m_subpassInputLayout = _createDescriptorSetLayout(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,       VK_SHADER_STAGE_FRAGMENT_BIT);
+        m_storageLayout      = _createDescriptorSetLayout(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          VK_SHADER_STAGE_COMPUTE_BIT);
+
+        m_setPools[SAMPLED_SET].layout       = m_dsetLayout;
+        m_setPools[SAMPLED_SET].type         = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        m_setPools[SUBPASS_INPUT_SET].layout = m_subpassInputLayout;
+        m_setPools[SUBPASS_INPUT_SET].type   = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        m_setPools[STORAGE_SET].layout       = m_storageLayout;
+        m_setPools[STORAGE_SET].type         = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    }
+
+    VkDescriptorSetLayout _createDescriptorSetLayout(VkDescriptorType type, VkShaderStageFlags stages)
+    {
         VkDescriptorSetLayoutBinding binding = {};
         binding.binding                      = 0;
         binding.descriptorCount              = maxInputTextures;
-        binding.descriptorType               = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        binding.stageFlags                   = VK_SHADER_STAGE_FRAGMENT_BIT;
+        binding.descriptorType               = type;
+        binding.stageFlags                   = stages;
 
         VkDescriptorSetLayoutCreateInfo ci = {};
         ci.sType                           = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -678,22 +3151,28 @@ protected:
                 std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
                 assert(res == VK_SUCCESS);
             }
-            m_dsetLayout = l;
         }
-
+        return l;
     }
 
-    VkDescriptorPool _createDescriptorPool()
+    // A pool shared by every node, with room for setCount[k] sets of each kind.
+    // Sets are never freed, they are recycled by _writeDescriptorSets( )
+    VkDescriptorPool _createDescriptorPool(uint32_t const (&setCount)[SET_KIND_COUNT])
     {
-        uint32_t maxSets = 3;
-        VkDescriptorPoolCreateInfo Ci = {};
-
-        std::vector<VkDescriptorPoolSize> poolSizes = {
-            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxSets * maxInputTextures}
-        };
+        uint32_t maxSets = 0;
+        std::vector<VkDescriptorPoolSize> poolSizes;
+        for(uint32_t k=0;k<SET_KIND_COUNT;k++)
+        {
+            if(setCount[k] == 0)
+                continue;
+            maxSets += setCount[k];
+            poolSizes.push_back({m_setPools[k].type, setCount[k] * maxInputTextures});
+        }
+        if(maxSets == 0)
+            return VK_NULL_HANDLE;
 
+        VkDescriptorPoolCreateInfo Ci = {};
         Ci.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        Ci.flags         = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
         Ci.maxSets       = maxSets;
         Ci.poolSizeCount = poolSizes.size();
         Ci.pPoolSizes    = poolSizes.data();
@@ -712,14 +3191,14 @@ protected:
 
 
     static
-    VKImageInfo       image_Create(  VkDevice device
-                             ,VmaAllocator m_allocator
-                             ,VkExtent3D extent
-                             ,VkFormat format
-                             ,VkImageViewType viewType
-                             ,uint32_t arrayLayers
-                             ,uint32_t miplevels // maximum mip levels
-                             ,VkImageUsageFlags additionalUsageFlags)
+    VkImageCreateInfo _getImageCreateInfo( VkExtent3D extent
+                                          ,VkFormat format
+                                          ,uint32_t arrayLayers
+                                          ,uint32_t miplevels // maximum mip levels
+                                          ,VkImageUsageFlags usage
+                                          ,uint32_t familyCount = 0 // queue families sharing the image, if more than one
+                                          ,uint32_t const * families = nullptr
+                                          ,VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT)
     {
         VkImageCreateInfo imageInfo{};
 
@@ -730,47 +3209,35 @@ protected:
         imageInfo.mipLevels     = miplevels;
         imageInfo.arrayLayers   = arrayLayers;
 
-        imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;// vk::SampleCountFlagBits::e1;
+        imageInfo.samples       = samples;
         imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;// vk::ImageTiling::eOptimal;
-        imageInfo.usage         = additionalUsageFlags | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;// vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst;
+        imageInfo.usage         = usage;
         imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;// vk::SharingMode::eExclusive;
+        if( familyCount > 1 )
+        {
+            imageInfo.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+            imageInfo.queueFamilyIndexCount = familyCount;
+            imageInfo.pQueueFamilyIndices   = families;
+        }
         imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;// vk::ImageLayout::eUndefined;
 
         if( arrayLayers == 6)
             imageInfo.flags |=  VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;// vk::ImageCreateFlagBits::eCubeCompatible;
 
-        VmaAllocationCreateInfo allocCInfo = {};
-        allocCInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-
-        VkImage           image;
-        VmaAllocation     allocation;
-        VmaAllocationInfo allocInfo;
-
-        VkImageCreateInfo & imageInfo_c = imageInfo;
-        {
-            auto res = vmaCreateImage(m_allocator,  &imageInfo_c,  &allocCInfo, &image, &allocation, &allocInfo);
-            if (res != VK_SUCCESS)
-            {
-                std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
-                assert(res == VK_SUCCESS);
-            }
-        }
-
-        VKImageInfo I;
-        I.image      = image;
-        I.info       = imageInfo;
-        I.allocInfo  = allocInfo;
-        I.allocation = allocation;
-        I.viewType   = viewType;
+        return imageInfo;
+    }
 
+    static
+    void _createImageView(VkDevice device, VKImageInfo & I)
+    {
         // create the image view
         {
             {
                 VkImageViewCreateInfo ci{};
                 ci.sType      = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
                 ci.image      = I.image;
-                ci.viewType   = viewType;
-                ci.format     = format;
+                ci.viewType   = I.viewType;
+                ci.format     = I.info.format;
                 ci.components = {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A};
 
                 ci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -803,53 +3270,153 @@ protected:
                         assert(res == VK_SUCCESS);
                     }
                 }
-                // Create one image view per mipmap level
-#if 0
-                for(uint32_t i=0;i<miplevels;i++)
+                // Create one image view per mipmap level, they
+                // are rendered to and sampled one at a time
+                for(uint32_t i=0;i<I.info.mipLevels && I.info.mipLevels > 1;i++)
                 {
                     ci.subresourceRange.baseMipLevel = i;
                     ci.subresourceRange.levelCount = 1;
 
                     VkImageView vv;
-                    VKB_CHECK_RESULT( vkCreateImageView(device, &ci, nullptr, &vv) );
-                    I.mipMapViews.push_back(vv);
+                    auto res = vkCreateImageView(device, &ci, nullptr, &vv);
+                    if (res != VK_SUCCESS)
+                    {
+                        std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+                        assert(res == VK_SUCCESS);
+                    }
+                    I.mipViews.push_back(vv);
                 }
-#endif
             }
         }
+    }
+
+    static VkSamplerAddressMode _addressMode(SamplerAddressMode mode)
+    {
+        switch(mode)
+        {
+            case SamplerAddressMode::REPEAT:          return VK_SAMPLER_ADDRESS_MODE_REPEAT;
+            case SamplerAddressMode::CLAMP_TO_EDGE:   return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+            case SamplerAddressMode::CLAMP_TO_BORDER: return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+            default:                                  return VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
+        }
+    }
+
+    // Returns the sampler for the definition, creating it the first time
+    // it is used. Samplers are shared by every image and only destroyed
+    // by destroy( ), so resizing never creates or destroys them.
+    VkSampler _getSampler(SamplerDefinition const & def)
+    {
+        auto & sampler = _samplers[def];
+        if(sampler != VK_NULL_HANDLE)
+            return sampler;
+
+        auto filter  = def.filter == SamplerFilter::LINEAR ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+        auto address = _addressMode(def.addressMode);
+
+        VkSamplerCreateInfo ci = {};
+        ci.sType                   = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        ci.magFilter               = filter;
+        ci.minFilter               = filter;
+        ci.mipmapMode              = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        ci.addressModeU            = address;
+        ci.addressModeV            = address;
+        ci.addressModeW            = address;
+        ci.mipLodBias              = 0.0f;
+        ci.anisotropyEnable        = VK_FALSE;
+        ci.maxAnisotropy           = 1;
+        ci.compareEnable           = VK_FALSE;
+        ci.compareOp               = VK_COMPARE_OP_ALWAYS;
+        ci.minLod                  = 0;
+        ci.maxLod                  = VK_LOD_CLAMP_NONE;
+        ci.borderColor             = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+        ci.unnormalizedCoordinates = VK_FALSE;
+
+        auto res = vkCreateSampler(m_device, &ci, nullptr, &sampler);
+        if (res != VK_SUCCESS)
+        {
+            std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+            assert(res == VK_SUCCESS);
+        }
+        return sampler;
+    }
+
+    static
+    VKImageInfo       image_Create(  VkDevice device
+                             ,VmaAllocator m_allocator
+                             ,VkExtent3D extent
+                             ,VkFormat format
+                             ,VkImageViewType viewType
+                             ,uint32_t arrayLayers
+                             ,uint32_t miplevels // maximum mip levels
+                             ,VkImageUsageFlags usage
+                             ,uint32_t familyCount = 0
+                             ,uint32_t const * families = nullptr
+                             ,VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT
+                             ,VmaMemoryUsage memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY)
+    {
+        VkImageCreateInfo imageInfo = _getImageCreateInfo(extent, format, arrayLayers, miplevels, usage, familyCount, families, samples);
+
+        VmaAllocationCreateInfo allocCInfo = {};
+        allocCInfo.usage = memoryUsage;
 
+        VkImage           image;
+        VmaAllocation     allocation;
+        VmaAllocationInfo allocInfo;
 
-        // create a sampler
+        VkImageCreateInfo & imageInfo_c = imageInfo;
         {
-            // Temporary 1-mipmap sampler
-            VkSamplerCreateInfo ci;
-            ci.sType                   =  VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-            ci.magFilter               =  VK_FILTER_LINEAR;//  vk::Filter::eLinear;
-            ci.minFilter               =  VK_FILTER_LINEAR;//  vk::Filter::eLinear;
-            ci.mipmapMode              =  VK_SAMPLER_MIPMAP_MODE_LINEAR;// vk::SamplerMipmapMode::eLinear ;
-            ci.addressModeU            =  VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;//vk::SamplerAddressMode::eRepeat ;
-            ci.addressModeV            =  VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;//vk::SamplerAddressMode::eRepeat ;
-            ci.addressModeW            =  VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;// vk::SamplerAddressMode::eRepeat ;
-            ci.mipLodBias              =  0.0f  ;
-            ci.anisotropyEnable        =  VK_FALSE;
-            ci.maxAnisotropy           =  1 ;
-            ci.compareEnable           =  VK_FALSE ;
-            ci.compareOp               =  VK_COMPARE_OP_ALWAYS;// vk::CompareOp::eAlways ;
-            ci.minLod                  =  0 ;
-            ci.maxLod                  =  VK_LOD_CLAMP_NONE;//static_cast<float>(miplevels);
-            ci.borderColor             =  VK_BORDER_COLOR_INT_OPAQUE_BLACK;// vk::BorderColor::eIntOpaqueBlack ;
-            ci.unnormalizedCoordinates =  VK_FALSE ;
+            auto res = vmaCreateImage(m_allocator,  &imageInfo_c,  &allocCInfo, &image, &allocation, &allocInfo);
+            if (res != VK_SUCCESS)
+            {
+                std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+                assert(res == VK_SUCCESS);
+            }
+        }
+
+        VKImageInfo I;
+        I.image      = image;
+        I.info       = imageInfo;
+        I.allocInfo  = allocInfo;
+        I.allocation = allocation;
+        I.viewType   = viewType;
 
-            ci.magFilter               =  VK_FILTER_LINEAR;//vk::Filter::eLinear;
-            ci.minFilter               =  VK_FILTER_LINEAR;//vk::Filter::eLinear;
+        _createImageView(device, I);
 
-            vkCreateSampler(device, &ci, nullptr, &I.linearSampler);
+        return I;
+    }
 
-            ci.magFilter               =  VK_FILTER_NEAREST;//vk::Filter::eNearest;
-            ci.minFilter               =  VK_FILTER_NEAREST;//vk::Filter::eNearest;
+    /**
+     * @brief image_CreateUnbound
+     *
+     * Creates the image without any memory bound to it. The image view
+     * cannot be created until memory has been bound, so it is left empty.
+     * The memory requirements are stored in the VKImageInfo
+     */
+    static
+    VKImageInfo       image_CreateUnbound(  VkDevice device
+                             ,VkExtent3D extent
+                             ,VkFormat format
+                             ,VkImageViewType viewType
+                             ,uint32_t arrayLayers
+                             ,uint32_t miplevels // maximum mip levels
+                             ,VkImageUsageFlags usage
+                             ,uint32_t familyCount = 0
+                             ,uint32_t const * families = nullptr
+                             ,VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT)
+    {
+        VKImageInfo I;
+        I.info     = _getImageCreateInfo(extent, format, arrayLayers, miplevels, usage, familyCount, families, samples);
+        I.viewType = viewType;
 
-            vkCreateSampler(device, &ci, nullptr, &I.nearestSampler);
+        {
+            auto res = vkCreateImage(device, &I.info, nullptr, &I.image);
+            if (res != VK_SUCCESS)
+            {
+                std::cout << "Fatal : VkResult is \"" << res << "\" in " << __FILE__ << " at line " << __LINE__ << std::endl;
+                assert(res == VK_SUCCESS);
+            }
         }
+        vkGetImageMemoryRequirements(device, I.image, &I.memoryRequirements);
 
         return I;
     }
@@ -859,11 +3426,82 @@ protected:
 
     std::map<std::string, VKNodeInfo>                   _nodes;
     std::map<std::string, VKImageInfo>                  _images;
+    std::map<std::string, VKBufferInfo>                 _buffers;
+    std::map<std::string, VKImportInfo>                 _imports;
+    std::map<SamplerDefinition, VkSampler>              _samplers; // shared by all the images
+
+    // render passes and framebuffers shared between the nodes, see _createRenderPasses( )
+    struct CachedFramebuffer
+    {
+        VkFramebuffer frameBuffer = VK_NULL_HANDLE;
+        uint64_t      resize      = 0; // the last resize it was used in
+    };
+    std::map<std::vector<uint32_t>, VkRenderPass>       m_renderPasses;
+    std::map<std::vector<uint64_t>, CachedFramebuffer>  m_framebuffers;
+    uint64_t                                            m_resizeCount = 0;
     std::map<std::string, std::function<void(Frame &)>> _renderers;
 
+    std::vector<TransientHeap>                          m_transientHeaps;
+    std::vector<PassRecord>                             m_plan;
+    std::vector<VkImageMemoryBarrier>                   m_barriers;
+    std::vector<VkBufferMemoryBarrier>                  m_bufferBarriers;
+    PassRecord                                          m_endOfFrame; // barriers recorded after the last pass
+    Frame                                               m_frame = {}; // reused for every pass
+
+    // the plan of the other frame parity, when the graph uses history
+    struct FramePlan
+    {
+        std::vector<PassRecord>            plan;
+        std::vector<VkImageMemoryBarrier>  barriers;
+        std::vector<VkBufferMemoryBarrier> bufferBarriers;
+        PassRecord                         endOfFrame;
+    };
+    FramePlan                                           m_otherPlan;
+    bool                                                m_pingPong = false;
+
+    // parallel recording
+    WorkerPool                                          m_workerPool;
+    std::vector<RecordingWorker>                        m_workers;
+    std::function<void(uint32_t)>                       m_recordJob;
+    std::vector<uint32_t>                               m_levelOffset; // plan indices of level l are m_levelPasses[ m_levelOffset[l] .. m_levelOffset[l+1] )
+    std::vector<uint32_t>                               m_levelPasses;
+    RenderInfo const *                                  m_recordInfo  = nullptr;
+    uint32_t                                            m_recordLevel = 0;
+
+    // async compute
+    AsyncQueue                                          m_queues[2];
+    uint32_t                                            m_queueFamilies[2] = {0, 0};
+    std::vector<BatchRecord>                            m_batches; // empty when every pass is on the graphics queue
+    uint32_t                                            m_userBatch = QueueBatch::noWait; // recorded into RenderInfo::commandBuffer
+    TimelineSubmitInfo                                  m_submitInfo;
+
+    // descriptor sets
+    std::vector<VkDescriptorPool>                       m_descriptorPools; // shared by every node, see _writeDescriptorSets( )
+    SetPool                                             m_setPools[SET_KIND_COUNT];
+    std::vector<SetWrite>                               m_setWrites; // queued until buildExecutionPlan( )
+
     VkDescriptorSetLayout m_dsetLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_subpassInputLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_storageLayout      = VK_NULL_HANDLE;
     VkDevice              m_device     = VK_NULL_HANDLE;
     VmaAllocator          m_allocator  = VK_NULL_HANDLE;
+    bool                  m_useTransientHeap = false;
+    bool                  m_lazilyAllocatedMemory = false;
+
+    // timestamp queries of each frame index, see setProfiling( )
+    struct QueryFrame
+    {
+        VkQueryPool pool     = VK_NULL_HANDLE;
+        uint32_t    recorded = 0; // the number of passes whose timestamps were written
+    };
+    bool                    m_profiling       = false;
+    float                   m_timestampPeriod = 1.0f; // nanoseconds per tick
+    uint32_t                m_queryCapacity   = 0;    // passes the query pools have room for
+    std::vector<QueryFrame> m_queryFrames;
+    std::vector<uint64_t>   m_queryResults;
+    bool                  m_imagelessFramebuffers = false;
+    uint32_t              m_framesInFlight   = 1;
+    uint32_t              m_frameIndex       = 0; // given to operator()
 };
 
 }
@@ -0,0 +1,107 @@
+#ifndef GNL_FRAME_GRAPH_WORKER_POOL_H
+#define GNL_FRAME_GRAPH_WORKER_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace gfg
+{
+/**
+ * @brief The WorkerPool struct
+ *
+ * A fixed set of threads which all run the same job. The job
+ * is given the index of the worker running it so that each worker
+ * can use its own resources (eg: command pools).
+ */
+struct WorkerPool
+{
+    ~WorkerPool()
+    {
+        stop();
+    }
+
+    void start(uint32_t threadCount)
+    {
+        stop();
+        m_quit = false;
+        for(uint32_t i=0;i<threadCount;i++)
+        {
+            m_threads.emplace_back([this, i, generation = m_generation]() mutable
+            {
+                while(true)
+                {
+                    std::function<void(uint32_t)> const * job = nullptr;
+                    {
+                        std::unique_lock<std::mutex> L(m_mutex);
+                        m_start.wait(L, [&]{ return m_quit || m_generation != generation; });
+                        if(m_quit)
+                            return;
+                        generation = m_generation;
+                        job        = m_job;
+                    }
+
+                    (*job)(i);
+
+                    {
+                        std::lock_guard<std::mutex> L(m_mutex);
+                        if(--m_running == 0)
+                            m_done.notify_one();
+                    }
+                }
+            });
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> L(m_mutex);
+            m_quit = true;
+        }
+        m_start.notify_all();
+        for(auto & t : m_threads)
+            t.join();
+        m_threads.clear();
+    }
+
+    uint32_t size() const
+    {
+        return static_cast<uint32_t>(m_threads.size());
+    }
+
+    /**
+     * @brief run
+     * @param job
+     *
+     * Runs job(workerIndex) on every worker and waits
+     * until all of them have finished.
+     */
+    void run(std::function<void(uint32_t)> const & job)
+    {
+        if(m_threads.empty())
+            return;
+        std::unique_lock<std::mutex> L(m_mutex);
+        m_job     = &job;
+        m_running = size();
+        m_generation++;
+        m_start.notify_all();
+        m_done.wait(L, [&]{ return m_running == 0; });
+        m_job = nullptr;
+    }
+
+protected:
+    std::vector<std::thread>              m_threads;
+    std::mutex                            m_mutex;
+    std::condition_variable               m_start;
+    std::condition_variable               m_done;
+    std::function<void(uint32_t)> const * m_job        = nullptr;
+    uint64_t                              m_generation = 0;
+    uint32_t                              m_running    = 0;
+    bool                                  m_quit       = false;
+};
+}
+
+#endif
@@ -4,9 +4,15 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <deque>
 #include <map>
-#include <variant>
-#include <unordered_set>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+#include <tuple>
+#include <stdexcept>
+#include <cassert>
 
 #if defined GFG_LOGGING
 #include <spdlog/spdlog.h>
@@ -323,21 +329,350 @@ inline bool isDepth(FrameGraphFormat f)
     }
     return false;
 }
+inline bool hasStencil(FrameGraphFormat f)
+{
+    return f == FrameGraphFormat::D24_UNORM_S8_UINT ||
+           f == FrameGraphFormat::D32_SFLOAT_S8_UINT;
+}
+/**
+ * @brief The Handle struct
+ *
+ * A typed index into one of the tables of a compiled FrameGraph.
+ * The Tag type is only used to stop a handle for one table
+ * from being used to index a different table.
+ */
+template<typename Tag>
+struct Handle
+{
+    using index_type = uint32_t;
+    static constexpr index_type null_index = std::numeric_limits<index_type>::max();
+
+    index_type index = null_index;
+
+    bool valid() const
+    {
+        return index != null_index;
+    }
+    explicit operator bool() const
+    {
+        return valid();
+    }
+    bool operator==(Handle const & other) const
+    {
+        return index == other.index;
+    }
+    bool operator!=(Handle const & other) const
+    {
+        return index != other.index;
+    }
+    bool operator<(Handle const & other) const
+    {
+        return index < other.index;
+    }
+};
+
+using PassHandle   = Handle<struct PassTag>;
+using TargetHandle = Handle<struct TargetTag>;
+using ImageHandle  = Handle<struct ImageTag>;
+using BufferHandle = Handle<struct BufferTag>;
+using BufferAllocationHandle = Handle<struct BufferAllocationTag>;
+
+/**
+ * @brief The Span struct
+ *
+ * A non-owning view of a contiguous range of a table.
+ */
+template<typename T>
+struct Span
+{
+    T const * first = nullptr;
+    T const * last  = nullptr;
+
+    T const * begin() const { return first; }
+    T const * end()   const { return last;  }
+    size_t    size()  const { return static_cast<size_t>(last - first); }
+    bool      empty() const { return first == last; }
+    T const & operator[](size_t i) const { return first[i]; }
+};
+
+/**
+ * @brief scaleExtent
+ * @param extent
+ * @param scale
+ * @return
+ *
+ * Returns the extent scaled and rounded to the nearest pixel. An
+ * extent which is not zero never scales below a single pixel.
+ */
+inline uint32_t scaleExtent(uint32_t extent, float scale)
+{
+    if(extent == 0)
+        return 0;
+    auto e = static_cast<uint32_t>(static_cast<float>(extent) * scale + 0.5f);
+    return std::max(e, 1u);
+}
+
+/**
+ * @brief formatByteSize
+ * @param f
+ * @return
+ *
+ * Returns the number of bytes a single pixel of the format uses
+ */
+inline uint32_t formatByteSize(FrameGraphFormat f)
+{
+    switch(f)
+    {
+        case FrameGraphFormat::R8_UNORM:
+        case FrameGraphFormat::R8_SNORM:
+        case FrameGraphFormat::R8_UINT:
+        case FrameGraphFormat::R8_SINT:
+            return 1;
+        case FrameGraphFormat::R8G8_UNORM:
+        case FrameGraphFormat::R8G8_SNORM:
+        case FrameGraphFormat::R8G8_UINT:
+        case FrameGraphFormat::R8G8_SINT:
+        case FrameGraphFormat::R16_UNORM:
+        case FrameGraphFormat::R16_SNORM:
+        case FrameGraphFormat::R16_UINT:
+        case FrameGraphFormat::R16_SINT:
+        case FrameGraphFormat::R16_SFLOAT:
+            return 2;
+        case FrameGraphFormat::R8G8B8_UNORM:
+        case FrameGraphFormat::R8G8B8_SNORM:
+        case FrameGraphFormat::R8G8B8_UINT:
+        case FrameGraphFormat::R8G8B8_SINT:
+            return 3;
+        case FrameGraphFormat::R8G8B8A8_UNORM:
+        case FrameGraphFormat::R8G8B8A8_SNORM:
+        case FrameGraphFormat::R8G8B8A8_UINT:
+        case FrameGraphFormat::R8G8B8A8_SINT:
+        case FrameGraphFormat::R16G16_UNORM:
+        case FrameGraphFormat::R16G16_SNORM:
+        case FrameGraphFormat::R16G16_UINT:
+        case FrameGraphFormat::R16G16_SINT:
+        case FrameGraphFormat::R16G16_SFLOAT:
+        case FrameGraphFormat::R32_UINT:
+        case FrameGraphFormat::R32_SINT:
+        case FrameGraphFormat::R32_SFLOAT:
+        case FrameGraphFormat::D32_SFLOAT:
+        case FrameGraphFormat::D24_UNORM_S8_UINT:
+            return 4;
+        case FrameGraphFormat::R16G16B16_UNORM:
+        case FrameGraphFormat::R16G16B16_SNORM:
+        case FrameGraphFormat::R16G16B16_UINT:
+        case FrameGraphFormat::R16G16B16_SINT:
+        case FrameGraphFormat::R16G16B16_SFLOAT:
+            return 6;
+        case FrameGraphFormat::R16G16B16A16_UNORM:
+        case FrameGraphFormat::R16G16B16A16_SNORM:
+        case FrameGraphFormat::R16G16B16A16_UINT:
+        case FrameGraphFormat::R16G16B16A16_SINT:
+        case FrameGraphFormat::R16G16B16A16_SFLOAT:
+        case FrameGraphFormat::R32G32_UINT:
+        case FrameGraphFormat::R32G32_SINT:
+        case FrameGraphFormat::R32G32_SFLOAT:
+        case FrameGraphFormat::D32_SFLOAT_S8_UINT:
+            return 8;
+        case FrameGraphFormat::R32G32B32_UINT:
+        case FrameGraphFormat::R32G32B32_SINT:
+        case FrameGraphFormat::R32G32B32_SFLOAT:
+            return 12;
+        case FrameGraphFormat::R32G32B32A32_UINT:
+        case FrameGraphFormat::R32G32B32A32_SINT:
+        case FrameGraphFormat::R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            break;
+    }
+    return 0;
+}
+
+// DEFAULT leaves the choice to the executor: the OpenGL executor
+// samples LINEAR with CLAMP_TO_EDGE, the Vulkan executor NEAREST with
+// MIRRORED_REPEAT
+enum class SamplerFilter : uint8_t
+{
+    DEFAULT,
+    NEAREST,
+    LINEAR
+};
+
+enum class SamplerAddressMode : uint8_t
+{
+    DEFAULT,
+    MIRRORED_REPEAT,
+    REPEAT,
+    CLAMP_TO_EDGE,
+    CLAMP_TO_BORDER
+};
+
+/**
+ * @brief The SamplerDefinition struct
+ *
+ * How a pass samples one of its inputs. Executors share a single
+ * sampler between all the inputs with the same definition.
+ */
+struct SamplerDefinition
+{
+    SamplerFilter      filter      = SamplerFilter::DEFAULT;
+    SamplerAddressMode addressMode = SamplerAddressMode::DEFAULT;
+
+    bool operator==(SamplerDefinition const & other) const
+    {
+        return filter == other.filter && addressMode == other.addressMode;
+    }
+    bool operator<(SamplerDefinition const & other) const
+    {
+        return std::tie(filter, addressMode) < std::tie(other.filter, other.addressMode);
+    }
+};
+
 struct RenderTargetDefinition
 {
-    std::string      name;
-    FrameGraphFormat format;
+    std::string       name;
+    FrameGraphFormat  format = FrameGraphFormat::UNDEFINED;
+    SamplerDefinition sampler; // used if the target is sampled
+    uint32_t          mip    = 0; // the mip level of the target's image
+    uint32_t          samples = 1; // multisampled if more than 1, see RenderPassNode::output( )
     //uint32_t         width  = 0;
     //uint32_t         height = 0;
 };
 
+/**
+ * @brief mipTargetName
+ * @param name
+ * @param mip
+ * @return
+ *
+ * The name of the render target of a mip level declared with
+ * inputMip( )/outputMip( ). Mip 0 is the target itself.
+ */
+inline std::string mipTargetName(std::string const & name, uint32_t mip)
+{
+    return mip ? name + "#mip" + std::to_string(mip) : name;
+}
+
+/**
+ * @brief resolveTargetName
+ * @param name
+ * @return
+ *
+ * The name of the render target a multisampled target is
+ * resolved into, see RenderPassNode::output( )
+ */
+inline std::string resolveTargetName(std::string const & name)
+{
+    return name + "#resolve";
+}
+
+// A render target whose image is owned by the application,
+// see FrameGraph::importTarget( )
+struct ImportedTargetDefinition
+{
+    std::string      name;
+    FrameGraphFormat format = FrameGraphFormat::UNDEFINED;
+    uint32_t         width  = 0; // if zer0, use swapchain's size
+    uint32_t         height = 0;
+};
+
+/**
+ * @brief The BufferUsage enum
+ *
+ * How a buffer is used by the passes which read and write it.
+ * These can be or'ed together.
+ */
+enum class BufferUsage : uint32_t
+{
+    STORAGE  = 1,  // read/written as a storage buffer
+    UNIFORM  = 2,  // read as a uniform buffer
+    INDIRECT = 4,  // indirect draw/dispatch arguments
+    VERTEX   = 8,
+    INDEX    = 16
+};
+
+inline BufferUsage operator|(BufferUsage a, BufferUsage b)
+{
+    return static_cast<BufferUsage>(static_cast<uint32_t>(a) | static_cast<uint32_t>(b));
+}
+inline BufferUsage operator&(BufferUsage a, BufferUsage b)
+{
+    return static_cast<BufferUsage>(static_cast<uint32_t>(a) & static_cast<uint32_t>(b));
+}
+inline BufferUsage& operator|=(BufferUsage & a, BufferUsage b)
+{
+    return a = a | b;
+}
+inline bool hasUsage(BufferUsage usage, BufferUsage flag)
+{
+    return (usage & flag) == flag;
+}
+
+struct BufferResourceDefinition
+{
+    std::string name;
+    uint64_t    size  = 0; // in bytes
+    BufferUsage usage = BufferUsage::STORAGE;
+};
+
+struct BufferDefinition
+{
+    std::string name;
+    uint64_t    size  = 0; // in bytes
+    BufferUsage usage = BufferUsage::STORAGE; // all the ways the buffer is used
+
+    // the lifetime of the buffer as positions in the execution
+    // order. This spans all the graph buffers that use this buffer
+    uint32_t    firstUse = 0;
+    uint32_t    lastUse  = 0;
+
+    // the buffer is accessed by a pass on the compute queue
+    bool        asyncCompute = false;
+};
+
 struct ImageDefinition
 {
     std::string      name;
     FrameGraphFormat format;
     uint32_t         width     = 0;
     uint32_t         height    = 0;
+    float            scale     = 1.0f; // of the swapchain's size, if width/height are zer0
+    uint32_t         mipLevels = 1;
+    uint32_t         samples   = 1;
     bool             resizable = true;
+
+    // the lifetime of the image as positions in the execution
+    // order. This spans all the render targets that use this image
+    uint32_t         firstUse  = 0;
+    uint32_t         lastUse   = 0;
+
+    // all the targets using this image are only used inside a
+    // single merged render pass, so the image never needs to be
+    // written to memory
+    bool             transient       = false;
+
+    // the image is read through a sampler, including history reads
+    bool             sampled         = false;
+
+    // the image is rendered to by a graphics pass
+    bool             attachment      = false;
+
+    // the image is read as an input attachment by a merged render pass
+    bool             inputAttachment = false;
+
+    // the image is written or read as a storage image by a compute pass
+    bool             storage         = false;
+
+    // the image is accessed by a pass on the compute queue
+    bool             asyncCompute    = false;
+
+    // the image is owned by the application and must not be created
+    // by the executor. Its name is the name of the imported target.
+    bool             imported        = false;
+
+    // the image is one of the two images of a target read with
+    // inputHistory( ). Its contents are kept until the next frame.
+    bool             history         = false;
 };
 
 struct FrameBase
@@ -350,340 +685,1844 @@ struct FrameBase
     // this value may be different from imageWidth and imageHeight
     // These values will be less than the values above when you
     // set the renderpass to only reallocate when the
-    // image size increases
+    // image size increases, or use a resolution scale below 1.
+    // See ExecutorBase::setGrowOnly( )/setResolutionScale( ).
+    // Set the viewport and scissor to this extent.
     uint32_t renderableWidth  = 0;
     uint32_t renderableHeight = 0;
 
     uint32_t windowWidth  = 0;
     uint32_t windowHeight = 0;
 
-    bool     resizable        = false;
-};
+    // the pass renders to images sized to the window,
+    // its renderable extent follows the resolution scale
+    bool     resizable        = false;
+
+    // the sample count of the attachments,
+    // create the pass's pipelines with it
+    uint32_t samples          = 1;
+};
+
+enum class PassType : uint8_t
+{
+    GRAPHICS, // renders to color/depth attachments
+    COMPUTE   // reads/writes storage images
+};
+
+// the queue a pass is submitted to
+enum class QueueType : uint8_t
+{
+    GRAPHICS,
+    COMPUTE   // async compute, see ComputePassNode::setAsyncCompute( )
+};
+
+// how a pass reads one of its input render targets
+enum class InputType : uint8_t
+{
+    SAMPLED,    // read through a sampler
+    ATTACHMENT, // read only at the same pixel, see RenderPassNode::inputAttachment( )
+    STORAGE     // read as a storage image by a compute pass
+};
+
+// what happens to the contents of an attachment when
+// the render pass begins, see PassTable::outputLoadOp
+enum class LoadOp : uint8_t
+{
+    CLEAR,     // cleared to the pass's clear value
+    LOAD,      // the previous contents are kept, eg: an imported target
+    DONT_CARE  // every pixel is written, see RenderPassNode::setOverwrite( )
+};
+
+// and when it ends
+enum class StoreOp : uint8_t
+{
+    STORE,     // read by a later pass, the next frame or the application
+    DONT_CARE  // never read, eg: a depth buffer which is not sampled
+};
+
+/**
+ * @brief The RenderPassNode struct
+ *
+ * The declaration of a render pass. This is what is returned
+ * by FrameGraph::createRenderPass( ) and is used to describe the
+ * inputs and outputs of the pass. It is compiled into the
+ * FrameGraph's PassTable when FrameGraph::finalize( ) is called.
+ */
+struct RenderPassNode
+{
+    std::string name;
+    PassHandle  handle; // the index of this pass in the compiled PassTable
+    PassType    type  = PassType::GRAPHICS;
+    QueueType   queue = QueueType::GRAPHICS;
+
+    std::vector<RenderTargetDefinition> inputSampledRenderTargets;  // input render targets
+    std::vector<RenderTargetDefinition> inputAttachmentRenderTargets; // input render targets only read at the same pixel
+    std::vector<RenderTargetDefinition> inputStorageRenderTargets; // input render targets read as storage images (compute only)
+    std::vector<RenderTargetDefinition> outputRenderTargets; // output render targets
+    std::vector<RenderTargetDefinition> inputHistoryRenderTargets; // render targets read as they were in the previous frame
+    std::vector<BufferResourceDefinition> inputBuffers;
+    std::vector<BufferResourceDefinition> outputBuffers;
+    uint32_t                            width  = 0; // if zer0, use swapchain's size
+    uint32_t                            height = 0;
+    float                               scale  = 1.0f; // of the swapchain's size, if width/height are zer0
+    bool                                overwrite = false; // see setOverwrite( )
+
+    /**
+     * @brief input
+     * @param name
+     * @param sampler
+     * @return
+     *
+     * Sample the render target with the given filter and address mode.
+     */
+    RenderPassNode& input(std::string name, SamplerDefinition sampler={})
+    {
+        inputSampledRenderTargets.push_back({name, FrameGraphFormat::UNDEFINED, sampler});
+        return *this;
+    }
+    /**
+     * @brief inputAttachment
+     * @param name
+     * @return
+     *
+     * Read the render target only at the pixel being shaded. This allows
+     * the pass to be merged into the same render pass as the pass which
+     * writes the target, in which case the target is read as an input
+     * attachment (subpassLoad). Otherwise it is sampled like input( ).
+     */
+    RenderPassNode& inputAttachment(std::string name)
+    {
+        RenderTargetDefinition d;
+        d.name = name;
+        inputAttachmentRenderTargets.push_back(d);
+        return *this;
+    }
+    /**
+     * @brief output
+     * @param name
+     * @param format
+     * @param samples
+     * @return
+     *
+     * Render to the target. If samples is more than 1 the target is
+     * multisampled, and all the outputs of the pass must have the same
+     * sample count. Passes which read a multisampled target read a
+     * single sampled copy which is resolved at the end of this pass,
+     * so the multisampled image never leaves the render pass and is
+     * created as a transient image. Multisampled depth targets can
+     * not be read.
+     */
+    RenderPassNode& output(std::string name, FrameGraphFormat format=FrameGraphFormat::UNDEFINED, uint32_t samples=1)
+    {
+        assert(samples > 0);
+        outputRenderTargets.push_back({name, format, {}, 0, samples});
+        return *this;
+    }
+    /**
+     * @brief outputMip
+     * @param name
+     * @param mip
+     * @param format
+     * @return
+     *
+     * Write a single mip level of the render target. The mip levels of
+     * a target are rendered into one image, which is given as many levels
+     * as the highest mip written. Mip 0 is written with output( ) and
+     * sets the extent of the image, mip k is rendered at that extent
+     * divided by 2^k. Each mip level has its own writer and lifetime,
+     * eg: a bloom chain where each pass reads mip k and writes mip k+1.
+     */
+    RenderPassNode& outputMip(std::string name, uint32_t mip, FrameGraphFormat format=FrameGraphFormat::UNDEFINED)
+    {
+        outputRenderTargets.push_back({name, format, {}, mip});
+        return *this;
+    }
+    // sample a single mip level of the render target, see outputMip( )
+    RenderPassNode& inputMip(std::string name, uint32_t mip, SamplerDefinition sampler={})
+    {
+        inputSampledRenderTargets.push_back({name, FrameGraphFormat::UNDEFINED, sampler, mip});
+        return *this;
+    }
+    /**
+     * @brief inputHistory
+     * @param name
+     * @return
+     *
+     * Sample the render target as it was at the end of the previous
+     * frame. This does not depend on the pass which writes the target,
+     * so a pass can read the history of its own output, eg: for
+     * temporal anti-aliasing.
+     *
+     * The target is given two images which swap roles every frame, so
+     * no copies are made. History inputs are sampled after all the
+     * other sampled inputs of the pass. The history is undefined in
+     * the first frame and after a resize.
+     */
+    RenderPassNode& inputHistory(std::string name, SamplerDefinition sampler={})
+    {
+        inputHistoryRenderTargets.push_back({name, FrameGraphFormat::UNDEFINED, sampler});
+        return *this;
+    }
+    /**
+     * @brief outputBuffer
+     * @param name
+     * @param size
+     * @param usage
+     * @return
+     *
+     * Write to a buffer of size bytes. Like render targets, only
+     * one pass can write to a buffer and its memory can be reused
+     * by other buffers once all the passes reading it have executed.
+     */
+    RenderPassNode& outputBuffer(std::string name, uint64_t size, BufferUsage usage=BufferUsage::STORAGE)
+    {
+        outputBuffers.push_back({name, size, usage});
+        return *this;
+    }
+    // read a buffer written by another pass
+    RenderPassNode& inputBuffer(std::string name)
+    {
+        inputBuffers.push_back({name});
+        return *this;
+    }
+    RenderPassNode& setExtent(uint32_t _width, uint32_t _height)
+    {
+        width = _width;
+        height = _height;
+        return *this;
+    }
+    /**
+     * @brief setScale
+     * @param _scale
+     * @return
+     *
+     * Render at a fraction of the swapchain's size, eg: 0.5 for a
+     * half resolution pass. The extent follows the swapchain when
+     * the executor is resized. Targets written at the same scale
+     * can share images.
+     */
+    RenderPassNode& setScale(float _scale)
+    {
+        assert(_scale > 0.0f);
+        width  = 0;
+        height = 0;
+        scale  = _scale;
+        return *this;
+    }
+    /**
+     * @brief setOverwrite
+     * @param enable
+     * @return
+     *
+     * The pass writes every pixel of its color outputs, eg: a
+     * fullscreen pass, so they are neither cleared nor loaded when
+     * the render pass begins. Depth outputs are still cleared.
+     */
+    RenderPassNode& setOverwrite(bool enable=true)
+    {
+        overwrite = enable;
+        return *this;
+    }
+    PassHandle getHandle() const
+    {
+        return handle;
+    }
+};
+
+/**
+ * @brief The ComputePassNode struct
+ *
+ * A pass which is executed with compute dispatches. Its outputs are
+ * written as storage images instead of being rendered to, so no
+ * framebuffer is created for it. This is a view of the RenderPassNode
+ * stored in the FrameGraph.
+ */
+struct ComputePassNode
+{
+    RenderPassNode * node = nullptr;
+
+    // sample the render target
+    ComputePassNode& input(std::string name, SamplerDefinition sampler={})
+    {
+        node->input(name, sampler);
+        return *this;
+    }
+    // read the render target as a storage image (imageLoad)
+    ComputePassNode& storageInput(std::string name)
+    {
+        RenderTargetDefinition d;
+        d.name = name;
+        node->inputStorageRenderTargets.push_back(d);
+        return *this;
+    }
+    // write the render target as a storage image (imageStore)
+    ComputePassNode& output(std::string name, FrameGraphFormat format=FrameGraphFormat::UNDEFINED)
+    {
+        node->output(name, format);
+        return *this;
+    }
+    // a single mip level, see RenderPassNode::outputMip( )
+    ComputePassNode& outputMip(std::string name, uint32_t mip, FrameGraphFormat format=FrameGraphFormat::UNDEFINED)
+    {
+        node->outputMip(name, mip, format);
+        return *this;
+    }
+    ComputePassNode& inputMip(std::string name, uint32_t mip, SamplerDefinition sampler={})
+    {
+        node->inputMip(name, mip, sampler);
+        return *this;
+    }
+    // sample the render target as it was in the previous frame
+    ComputePassNode& inputHistory(std::string name, SamplerDefinition sampler={})
+    {
+        node->inputHistory(name, sampler);
+        return *this;
+    }
+    ComputePassNode& outputBuffer(std::string name, uint64_t size, BufferUsage usage=BufferUsage::STORAGE)
+    {
+        node->outputBuffer(name, size, usage);
+        return *this;
+    }
+    ComputePassNode& inputBuffer(std::string name)
+    {
+        node->inputBuffer(name);
+        return *this;
+    }
+    /**
+     * @brief setAsyncCompute
+     * @param enable
+     * @return
+     *
+     * Execute the pass on the compute queue, at the same time as the
+     * graphics passes it does not depend on. Executors which do not
+     * have a compute queue execute it with the other passes.
+     */
+    ComputePassNode& setAsyncCompute(bool enable=true)
+    {
+        node->queue = enable ? QueueType::COMPUTE : QueueType::GRAPHICS;
+        return *this;
+    }
+    ComputePassNode& setExtent(uint32_t _width, uint32_t _height)
+    {
+        node->setExtent(_width, _height);
+        return *this;
+    }
+    ComputePassNode& setScale(float _scale)
+    {
+        node->setScale(_scale);
+        return *this;
+    }
+    PassHandle getHandle() const
+    {
+        return node->getHandle();
+    }
+};
+
+/**
+ * @brief The PassTable struct
+ *
+ * Struct-of-arrays storage for all the compiled render passes.
+ * Index each array with PassHandle::index. The input/output
+ * edges of pass i are stored in inputs[ inputOffset[i] .. inputOffset[i+1] )
+ * and outputs[ outputOffset[i] .. outputOffset[i+1] )
+ */
+struct PassTable
+{
+    std::vector<std::string>  name;   // debug label
+    std::vector<PassType>     type;
+    std::vector<QueueType>    queue;
+    std::vector<uint32_t>     batch;  // index into FrameGraph::getQueueBatches( )
+    std::vector<uint32_t>     width;  // if zer0, use swapchain's size
+    std::vector<uint32_t>     height;
+    std::vector<float>        scale;  // of the swapchain's size, 1 if the extent is fixed
+    std::vector<uint32_t>     samples; // the sample count of the attachments the pass renders to
+
+    // the dependency level of the pass. A pass has a higher
+    // level than every pass it reads from, so passes with
+    // the same level do not depend on each other.
+    std::vector<uint32_t>     level;
+
+    // Adjacent passes may be merged into a single render pass.
+    // renderPass is the first pass of the merged render pass and
+    // subpass is the index of the pass within it.
+    std::vector<PassHandle>   renderPass;
+    std::vector<uint32_t>     subpass;
+
+    // the merged render pass uses an image of a history target, so
+    // executors build it once for each of the target's images
+    std::vector<uint8_t>      history;
+
+    std::vector<uint32_t>     inputOffset;
+    std::vector<uint32_t>     outputOffset;
+    std::vector<TargetHandle> inputs;
+    std::vector<TargetHandle> outputs;
+
+    // one per output edge, what happens to the attachment when the render
+    // pass begins and ends. Executors which merge render passes can
+    // also discard transient targets at the end of the render pass.
+    std::vector<LoadOp>       outputLoadOp;
+    std::vector<StoreOp>      outputStoreOp;
+
+    // one per input edge. subpassInput is set if the target is written
+    // in the same merged render pass and is read as an input attachment
+    std::vector<InputType>    inputType;
+    std::vector<uint8_t>      subpassInput;
+
+    // one per input edge, the sampler of SAMPLED inputs. Inputs
+    // which are not sampled have the default sampler.
+    std::vector<SamplerDefinition> inputSampler;
+
+    // the buffers the pass reads/writes, stored the same way
+    // as the render target inputs/outputs
+    std::vector<uint32_t>     inputBufferOffset;
+    std::vector<uint32_t>     outputBufferOffset;
+    std::vector<BufferHandle> inputBuffers;
+    std::vector<BufferHandle> outputBuffers;
+
+    // the targets read with inputHistory( ). These are not
+    // edges of the graph, so they do not affect the order.
+    std::vector<uint32_t>     historyInputOffset;
+    std::vector<TargetHandle> historyInputs;
+    std::vector<SamplerDefinition> historyInputSampler;
+
+    size_t size() const
+    {
+        return name.size();
+    }
+    Span<TargetHandle> getInputs(PassHandle p) const
+    {
+        return { inputs.data() + inputOffset[p.index], inputs.data() + inputOffset[p.index+1] };
+    }
+    Span<TargetHandle> getOutputs(PassHandle p) const
+    {
+        return { outputs.data() + outputOffset[p.index], outputs.data() + outputOffset[p.index+1] };
+    }
+    Span<LoadOp> getOutputLoadOps(PassHandle p) const
+    {
+        return { outputLoadOp.data() + outputOffset[p.index], outputLoadOp.data() + outputOffset[p.index+1] };
+    }
+    Span<StoreOp> getOutputStoreOps(PassHandle p) const
+    {
+        return { outputStoreOp.data() + outputOffset[p.index], outputStoreOp.data() + outputOffset[p.index+1] };
+    }
+    Span<InputType> getInputTypes(PassHandle p) const
+    {
+        return { inputType.data() + inputOffset[p.index], inputType.data() + inputOffset[p.index+1] };
+    }
+    Span<SamplerDefinition> getInputSamplers(PassHandle p) const
+    {
+        return { inputSampler.data() + inputOffset[p.index], inputSampler.data() + inputOffset[p.index+1] };
+    }
+    Span<uint8_t> getSubpassInputs(PassHandle p) const
+    {
+        return { subpassInput.data() + inputOffset[p.index], subpassInput.data() + inputOffset[p.index+1] };
+    }
+    Span<BufferHandle> getInputBuffers(PassHandle p) const
+    {
+        return { inputBuffers.data() + inputBufferOffset[p.index], inputBuffers.data() + inputBufferOffset[p.index+1] };
+    }
+    Span<BufferHandle> getOutputBuffers(PassHandle p) const
+    {
+        return { outputBuffers.data() + outputBufferOffset[p.index], outputBuffers.data() + outputBufferOffset[p.index+1] };
+    }
+    Span<TargetHandle> getHistoryInputs(PassHandle p) const
+    {
+        return { historyInputs.data() + historyInputOffset[p.index], historyInputs.data() + historyInputOffset[p.index+1] };
+    }
+    Span<SamplerDefinition> getHistoryInputSamplers(PassHandle p) const
+    {
+        return { historyInputSampler.data() + historyInputOffset[p.index], historyInputSampler.data() + historyInputOffset[p.index+1] };
+    }
+};
+
+/**
+ * @brief The TargetTable struct
+ *
+ * Struct-of-arrays storage for all the render targets. Index
+ * each array with TargetHandle::index. Only one pass can write to
+ * a render target, but multiple passes can read from it. The readers of
+ * target i are stored in readers[ readerOffset[i] .. readerOffset[i+1] )
+ */
+struct TargetTable
+{
+    std::vector<std::string>      name;   // debug label
+    std::vector<FrameGraphFormat> format;
+    std::vector<PassHandle>       writer; // invalid for imported targets which are only read
+    std::vector<ImageHandle>      image;  // the image this target is rendered into
+
+    // the image is owned by the application, see FrameGraph::importTarget( )
+    std::vector<uint8_t>          imported;
+
+    // the mip level of the image this target is rendered into, and the
+    // target of mip 0 which owns the image, see RenderPassNode::outputMip( )
+    std::vector<uint32_t>         mip;
+    std::vector<TargetHandle>     baseMip;
+
+    // A multisampled target which is read is resolved into a single
+    // sampled target at the end of the pass which writes it. resolve is
+    // that target, and resolveSource is the multisampled target of a
+    // resolve. The resolve follows its source in the writer's outputs.
+    std::vector<uint32_t>         samples;
+    std::vector<TargetHandle>     resolve;
+    std::vector<TargetHandle>     resolveSource;
+
+    // targets read with inputHistory( ) have a second image. The two
+    // images swap roles every frame, see getImage( )
+    std::vector<ImageHandle>      historyImage;
+
+    // the lifetime of the target as positions in the
+    // execution order, [firstUse, lastUse]
+    std::vector<uint32_t>         firstUse;
+    std::vector<uint32_t>         lastUse;
+
+    // the target is only written and read inside a single merged render pass
+    std::vector<uint8_t>          transient;
+
+    std::vector<uint32_t>         readerOffset;
+    std::vector<PassHandle>       readers;
+
+    size_t size() const
+    {
+        return name.size();
+    }
+    Span<PassHandle> getReaders(TargetHandle t) const
+    {
+        return { readers.data() + readerOffset[t.index], readers.data() + readerOffset[t.index+1] };
+    }
+    /**
+     * The image the target is written to in frames with the given
+     * parity (frame number % 2). Passes reading the history of the
+     * target read getImage(t, 1-parity).
+     */
+    ImageHandle getImage(TargetHandle t, uint32_t parity) const
+    {
+        return parity && historyImage[t.index].valid() ? historyImage[t.index] : image[t.index];
+    }
+};
+
+/**
+ * @brief The BufferTable struct
+ *
+ * Struct-of-arrays storage for all the buffers declared with
+ * outputBuffer( ). Index each array with BufferHandle::index. Buffers
+ * are assigned to BufferDefinitions the same way render targets
+ * are assigned to images.
+ */
+struct BufferTable
+{
+    std::vector<std::string>            name;   // debug label
+    std::vector<uint64_t>               byteSize;
+    std::vector<BufferUsage>            usage;
+    std::vector<PassHandle>             writer;
+    std::vector<BufferAllocationHandle> allocation; // the buffer this is stored in
+
+    // the lifetime of the buffer as positions in the
+    // execution order, [firstUse, lastUse]
+    std::vector<uint32_t>               firstUse;
+    std::vector<uint32_t>               lastUse;
+
+    std::vector<uint32_t>               readerOffset;
+    std::vector<PassHandle>             readers;
+
+    size_t size() const
+    {
+        return name.size();
+    }
+    Span<PassHandle> getReaders(BufferHandle b) const
+    {
+        return { readers.data() + readerOffset[b.index], readers.data() + readerOffset[b.index+1] };
+    }
+};
+
+/**
+ * @brief The QueueBatch struct
+ *
+ * A run of passes which are submitted to the same queue together.
+ * A new batch is started whenever a pass has to wait for a batch
+ * on the other queue, and a batch ends when the other queue waits
+ * for it. Batches are ordered by their first pass, which is also
+ * a valid order to submit them in.
+ */
+struct QueueBatch
+{
+    static constexpr uint32_t noWait = std::numeric_limits<uint32_t>::max();
+
+    QueueType             queue        = QueueType::GRAPHICS;
+    uint32_t              indexInQueue = 0; // the number of batches before this one on the same queue
+    std::vector<uint32_t> passes;           // positions in the execution order
+
+    // the batch on the other queue which must finish before this
+    // batch starts, or noWait
+    uint32_t              wait = noWait;
+
+    // all the batches of the other queue in the previous frame must
+    // finish before this batch starts
+    bool                  waitPreviousFrame = false;
+};
+
+/**
+ * @brief The ImageAllocationInfo struct
+ *
+ * Statistics about how the render targets were assigned
+ * to images when the graph was finalized.
+ */
+struct ImageAllocationInfo
+{
+    uint32_t renderTargetCount = 0; // number of render targets in the graph
+    uint32_t imageCount        = 0; // number of images that need to be created
+    uint32_t peakLiveTargets   = 0; // the most render targets alive during any one pass
+    uint64_t peakImageBytes    = 0; // the most bytes of images alive during any one pass, see updateImageAllocationInfo( )
+};
+
+struct FrameGraph
+{
+    /**
+     * @brief findExecutionOrder
+     * @return
+     *
+     * Finds the execution order of the render passes in the
+     * compiled graph. A pass will always appear after all the passes
+     * that write to its inputs. Passes with no dependencies between
+     * them are ordered by the order they were created in.
+     *
+     * Each pass and edge is visited exactly once, so this is O(V+E).
+     * Throws std::runtime_error if the graph contains a cycle.
+     */
+    std::vector<PassHandle> findExecutionOrder() const
+    {
+        auto passCount = m_passes.size();
+
+        std::vector<PassHandle> order;
+        order.reserve(passCount);
+
+        // the number of inputs that have not been written yet.
+        // Imported targets with no writer are always ready.
+        std::vector<uint32_t> waitingInputs(passCount);
+        for(uint32_t i=0;i<passCount;i++)
+        {
+            waitingInputs[i] = m_passes.inputBufferOffset[i+1] - m_passes.inputBufferOffset[i];
+            for(auto t : m_passes.getInputs({i}))
+            {
+                waitingInputs[i] += m_targets.writer[t.index].valid() ? 1 : 0;
+            }
+            if(waitingInputs[i] == 0)
+                order.push_back({i});
+        }
+
+        // Kahn's algorithm. order is used as the queue
+        for(size_t head=0; head < order.size(); head++)
+        {
+            for(auto t : m_passes.getOutputs(order[head]))
+            {
+                for(auto r : m_targets.getReaders(t))
+                {
+                    if(--waitingInputs[r.index] == 0)
+                        order.push_back(r);
+                }
+            }
+            for(auto b : m_passes.getOutputBuffers(order[head]))
+            {
+                for(auto r : m_bufferTable.getReaders(b))
+                {
+                    if(--waitingInputs[r.index] == 0)
+                        order.push_back(r);
+                }
+            }
+        }
+
+        if(order.size() != passCount)
+        {
+            for(uint32_t i=0;i<passCount;i++)
+            {
+                if(waitingInputs[i] != 0)
+                {
+                    GFG_ERROR("Cycle detected in frame graph at pass: {}", m_passes.name[i]);
+                    throw std::runtime_error("FrameGraph contains a cycle involving pass: " + m_passes.name[i]);
+                }
+            }
+        }
+        return order;
+    }
+
+    /**
+     * @brief createRenderPass
+     * @param name
+     * @return
+     *
+     * Create a renderPass and return the reference to it.
+     * If a pass with the same name already exists, it is replaced.
+     *
+     * The handle of the pass is available from RenderPassNode::getHandle( )
+     * and is valid once the graph has been finalized.
+     */
+    RenderPassNode& createRenderPass(std::string const & name)
+    {
+        RenderPassNode RPN;
+        RPN.name = name;
+
+        auto it = m_passLookup.find(name);
+        if(it != m_passLookup.end())
+        {
+            RPN.handle = it->second;
+            return m_passDecls[it->second.index] = RPN;
+        }
+
+        RPN.handle.index = static_cast<uint32_t>(m_passDecls.size());
+        m_passLookup[name] = RPN.handle;
+        return m_passDecls.emplace_back(std::move(RPN));
+    }
+
+    /**
+     * @brief createComputePass
+     * @param name
+     * @return
+     *
+     * Create a compute pass. Its outputs are written as storage images.
+     * If a pass with the same name already exists, it is replaced.
+     */
+    ComputePassNode createComputePass(std::string const & name)
+    {
+        auto & node = createRenderPass(name);
+        node.type   = PassType::COMPUTE;
+        return {&node};
+    }
+
+    /**
+     * @brief importTarget
+     * @param name
+     * @param format
+     * @param width
+     * @param height
+     *
+     * Declare a render target whose image is owned by the application,
+     * eg: an environment map or a texture shown by an editor. Passes can
+     * read it with input( ) and at most one pass can write it with
+     * output( ). The image is never created, aliased or destroyed by the
+     * executor; it must be given to the executor before resize( ).
+     *
+     * A width/height of zero means the image is the size of the swapchain.
+     * If a target with the same name was already imported, it is replaced.
+     */
+    void importTarget(std::string const & name, FrameGraphFormat format, uint32_t width=0, uint32_t height=0)
+    {
+        for(auto & I : m_imports)
+        {
+            if(I.name == name)
+            {
+                I = {name, format, width, height};
+                return;
+            }
+        }
+        m_imports.push_back({name, format, width, height});
+    }
+
+    /**
+     * @brief finalize
+     *
+     * Call this function after the graph has been generated.
+     * This will determine the order the render passes should
+     * be executed in as well as determine how many images
+     * should be created and which ones should be reused
+     *
+     * Each render target is alive from the pass that writes to it
+     * until the last pass that reads from it. Targets are assigned
+     * to images in order of their first use; a target reuses the
+     * compatible (same format and size) image which became free most
+     * recently, otherwise a new image is created. This is O(n log n)
+     * in the number of render targets.
+     *
+     * Buffers declared with outputBuffer( ) are assigned to
+     * BufferDefinitions in the same way, a buffer reuses a free
+     * buffer of the same size.
+     */
+    void finalize()
+    {
+        _compile();
+
+        m_executionOrder = findExecutionOrder();
+
+        m_passes.level.assign(m_passes.size(), 0);
+        for(auto p : m_executionOrder)
+        {
+            for(auto t : m_passes.getInputs(p))
+            {
+                if(!m_targets.writer[t.index].valid())
+                    continue;
+                auto w = m_targets.writer[t.index].index;
+                m_passes.level[p.index] = std::max(m_passes.level[p.index], m_passes.level[w] + 1);
+            }
+            for(auto b : m_passes.getInputBuffers(p))
+            {
+                auto w = m_bufferTable.writer[b.index].index;
+                m_passes.level[p.index] = std::max(m_passes.level[p.index], m_passes.level[w] + 1);
+            }
+        }
+
+        _mergeRenderPasses();
+
+        auto targetCount = static_cast<uint32_t>(m_targets.size());
+
+        // position of each pass in the execution order, and the
+        // positions of the first/last pass of each merged render pass
+        std::vector<uint32_t> position(m_passes.size());
+        std::vector<uint32_t> renderPassEnd(m_passes.size());
+        for(uint32_t i=0;i<m_executionOrder.size();i++)
+        {
+            auto p = m_executionOrder[i];
+            position[p.index] = i;
+            renderPassEnd[m_passes.renderPass[p.index].index] = i;
+        }
+
+        m_targets.firstUse.resize(targetCount);
+        m_targets.lastUse.resize(targetCount);
+        m_targets.transient.resize(targetCount);
+
+        // targets whose history is read need their contents
+        // to be kept until the next frame
+        std::vector<uint8_t> history(targetCount, 0);
+        for(auto t : m_passes.historyInputs)
+        {
+            history[t.index] = 1;
+        }
+
+        // Targets used by a merged render pass are alive for the whole
+        // render pass, otherwise two of its attachments could share an image
+        std::vector<uint32_t> sortedTargets;
+        sortedTargets.reserve(targetCount);
+        for(uint32_t t=0;t<targetCount;t++)
+        {
+            auto w     = m_targets.writer[t];
+            auto rp    = w.valid() ? m_passes.renderPass[w.index] : PassHandle{};
+            auto first = w.valid() ? position[rp.index] : std::numeric_limits<uint32_t>::max();
+            auto last  = w.valid() ? renderPassEnd[rp.index] : 0;
+            // attachments which are never read, or only read by the render
+            // pass that writes them, never leave tile memory. Multisampled
+            // targets are only read through their resolve.
+            bool transient = w.valid() && m_passes.type[w.index] == PassType::GRAPHICS && !m_targets.imported[t] && !history[t];
+            for(auto r : m_targets.getReaders({t}))
+            {
+                auto rr   = m_passes.renderPass[r.index];
+                first     = std::min(first, position[rr.index]);
+                last      = std::max(last, renderPassEnd[rr.index]);
+                transient = transient && rr == rp;
+            }
+            m_targets.firstUse[t]  = first;
+            m_targets.lastUse[t]   = last;
+            m_targets.transient[t] = transient;
+
+            // imported and history targets are given their own images,
+            // mip levels use the image of their mip 0
+            if(!m_targets.imported[t] && !history[t] && m_targets.mip[t] == 0)
+                sortedTargets.push_back(t);
+        }
+
+        // The image of a mip chain is allocated for the target of mip 0, so
+        // it has to live as long as all the mip levels. The mip levels keep
+        // their own lifetimes. None of them are transient.
+        std::vector<uint32_t> mipLevels(targetCount, 1);
+        for(uint32_t t=0;t<targetCount;t++)
+        {
+            auto b = m_targets.baseMip[t].index;
+            if(b == t)
+                continue;
+            if(history[b])
+                throw std::invalid_argument("FrameGraph cannot keep the history of a render target with mip levels: " + m_targets.name[b]);
+
+            mipLevels[b]           = std::max(mipLevels[b], m_targets.mip[t] + 1);
+            m_targets.firstUse[b]  = std::min(m_targets.firstUse[b], m_targets.firstUse[t]);
+            m_targets.lastUse[b]   = std::max(m_targets.lastUse[b], m_targets.lastUse[t]);
+            m_targets.transient[b] = 0;
+            m_targets.transient[t] = 0;
+        }
+
+        // Every target has a single writer, so only imported targets have
+        // contents to load. Targets which are never read are not stored,
+        // multisampled targets are only read through their resolve.
+        m_passes.outputLoadOp.assign(m_passes.outputs.size(), LoadOp::CLEAR);
+        m_passes.outputStoreOp.assign(m_passes.outputs.size(), StoreOp::DONT_CARE);
+        for(uint32_t p=0;p<m_passes.size();p++)
+        {
+            for(uint32_t k=m_passes.outputOffset[p]; k<m_passes.outputOffset[p+1]; k++)
+            {
+                auto t = m_passes.outputs[k].index;
+                if(m_targets.imported[t])
+                    m_passes.outputLoadOp[k] = LoadOp::LOAD;
+                if(m_targets.resolveSource[t].valid() || (m_passDecls[p].overwrite && !isDepth(m_targets.format[t])))
+                    m_passes.outputLoadOp[k] = LoadOp::DONT_CARE;
+                if(m_targets.imported[t] || history[t] || !m_targets.getReaders({t}).empty())
+                    m_passes.outputStoreOp[k] = StoreOp::STORE;
+            }
+        }
+
+        // how each target is accessed, so the executors only create
+        // images with the usages the graph needs. Input attachments which
+        // were not merged into the render pass are read through a sampler.
+        std::vector<uint8_t> sampled(targetCount, 0);
+        std::vector<uint8_t> attachment(targetCount, 0);
+        std::vector<uint8_t> inputAttachment(targetCount, 0);
+        std::vector<uint8_t> storage(targetCount, 0);
+        for(uint32_t i=0;i<m_passes.inputs.size();i++)
+        {
+            sampled[m_passes.inputs[i].index]         |= !m_passes.subpassInput[i] && m_passes.inputType[i] != InputType::STORAGE;
+            inputAttachment[m_passes.inputs[i].index] |= m_passes.subpassInput[i];
+            storage[m_passes.inputs[i].index]         |= m_passes.inputType[i] == InputType::STORAGE;
+        }
+        for(uint32_t t=0;t<targetCount;t++)
+        {
+            sampled[t] |= history[t];
+            if(m_targets.writer[t].valid())
+            {
+                attachment[t] |= m_passes.type[m_targets.writer[t].index] == PassType::GRAPHICS;
+                storage[t]    |= m_passes.type[m_targets.writer[t].index] == PassType::COMPUTE;
+            }
+        }
+
+        std::sort(sortedTargets.begin(), sortedTargets.end(), [&](uint32_t a, uint32_t b)
+        {
+            return std::tie(m_targets.firstUse[a], a) < std::tie(m_targets.firstUse[b], b);
+        });
+
+        using imageKey_type = std::tuple<FrameGraphFormat, uint32_t, uint32_t, float, uint32_t, uint32_t, bool>;
+        using active_type   = std::pair<uint32_t, ImageHandle>; // lastUse, image
+
+        // images which are not in use, grouped by (format, width, height, scale, mipLevels, samples)
+        std::map<imageKey_type, std::vector<ImageHandle>> freeImages;
+
+        // images which are in use, ordered by when they will be released
+        std::priority_queue<active_type, std::vector<active_type>, std::greater<active_type>> activeImages;
+
+        m_imageAllocationInfo = {};
+        m_imageAllocationInfo.renderTargetCount = targetCount;
+
+        // Imported targets use the application's image. History targets
+        // get two images which are alive for the whole frame, one is
+        // written while the other holds the previous frame.
+        auto lastPosition = m_executionOrder.empty() ? 0 : static_cast<uint32_t>(m_executionOrder.size()) - 1;
+        for(uint32_t t=0;t<targetCount;t++)
+        {
+            if(!m_targets.imported[t] && !history[t])
+                continue;
+
+            ImageDefinition imgDef;
+            imgDef.format          = m_targets.format[t];
+            imgDef.firstUse        = 0;
+            imgDef.lastUse         = lastPosition;
+            imgDef.sampled         = sampled[t] != 0;
+            imgDef.attachment      = attachment[t] != 0;
+            imgDef.inputAttachment = inputAttachment[t] != 0;
+            imgDef.storage         = storage[t] != 0;
+            if(m_targets.imported[t])
+            {
+                auto & I = *std::find_if(m_imports.begin(), m_imports.end(), [&](auto & d){ return d.name == m_targets.name[t]; });
+                imgDef.name     = I.name;
+                imgDef.width    = I.width;
+                imgDef.height   = I.height;
+                imgDef.imported = true;
+            }
+            else
+            {
+                auto p = m_targets.writer[t].index;
+                imgDef.name    = m_targets.name[t] + "_img";
+                imgDef.width   = m_passes.width[p];
+                imgDef.height  = m_passes.height[p];
+                imgDef.scale   = m_passes.scale[p];
+                imgDef.history = true;
+
+                m_targets.historyImage[t].index = static_cast<uint32_t>(m_images.size());
+                m_images.push_back(imgDef);
+                m_images.back().name += "_odd";
+            }
+            m_targets.image[t].index = static_cast<uint32_t>(m_images.size());
+            m_images.push_back(imgDef);
+
+            GFG_INFO("Render Target: {} -> {}", m_targets.name[t], imgDef.name);
+        }
+
+        for(auto t : sortedTargets)
+        {
+            auto first = m_targets.firstUse[t];
+            auto p     = m_targets.writer[t].index;
+
+            // release all the images whose targets are no
+            // longer used by the time this target is written
+            while(!activeImages.empty() && activeImages.top().first < first)
+            {
+                auto   img = activeImages.top().second;
+                auto & I   = m_images[img.index];
+                freeImages[ imageKey_type(I.format, I.width, I.height, I.scale, I.mipLevels, I.samples, I.transient) ].push_back(img);
+                activeImages.pop();
+            }
+
+            // transient images are kept apart so that they stay transient
+            auto & available = freeImages[ imageKey_type(m_targets.format[t], m_passes.width[p], m_passes.height[p], m_passes.scale[p], mipLevels[t], m_targets.samples[t], m_targets.transient[t]) ];
+            if(available.empty())
+            {
+                // generate new image
+                ImageDefinition imgDef;
+                imgDef.name   = m_targets.name[t] + "_img";
+                imgDef.format = m_targets.format[t];
+                imgDef.width  = m_passes.width[p];
+                imgDef.height = m_passes.height[p];
+                imgDef.scale  = m_passes.scale[p];
+                imgDef.mipLevels = mipLevels[t];
+                imgDef.samples   = m_targets.samples[t];
+                imgDef.firstUse = first;
+                imgDef.transient = m_targets.transient[t];
+
+                m_targets.image[t].index = static_cast<uint32_t>(m_images.size());
+                m_images.push_back(imgDef);
+            }
+            else
+            {
+                // the most recently released image is the tightest fit
+                m_targets.image[t] = available.back();
+                available.pop_back();
+            }
+            m_images[m_targets.image[t].index].lastUse = m_targets.lastUse[t];
+            m_images[m_targets.image[t].index].sampled         |= sampled[t] != 0;
+            m_images[m_targets.image[t].index].attachment      |= attachment[t] != 0;
+            m_images[m_targets.image[t].index].inputAttachment |= inputAttachment[t] != 0;
+            m_images[m_targets.image[t].index].storage         |= storage[t] != 0;
+
+            activeImages.push({m_targets.lastUse[t], m_targets.image[t]});
+            m_imageAllocationInfo.peakLiveTargets = std::max(m_imageAllocationInfo.peakLiveTargets, static_cast<uint32_t>(activeImages.size()));
+
+            GFG_INFO("Render Target: {} [{}, {}] -> {}", m_targets.name[t], first, m_targets.lastUse[t], m_images[m_targets.image[t].index].name);
+        }
+
+        for(uint32_t t=0;t<targetCount;t++)
+        {
+            auto b = m_targets.baseMip[t].index;
+            if(b == t)
+                continue;
+            m_targets.image[t] = m_targets.image[b];
+            m_images[m_targets.image[t].index].sampled         |= sampled[t] != 0;
+            m_images[m_targets.image[t].index].attachment      |= attachment[t] != 0;
+            m_images[m_targets.image[t].index].inputAttachment |= inputAttachment[t] != 0;
+            m_images[m_targets.image[t].index].storage         |= storage[t] != 0;
+        }
+
+        m_imageAllocationInfo.imageCount = static_cast<uint32_t>(m_images.size());
+
+        // the swapchain's size is not known yet, so only the
+        // images with a fixed extent are counted
+        updateImageAllocationInfo(0, 0);
 
-struct RenderPassNode
-{
-    std::string name;
+        // passes merged into a render pass are built together, so
+        // if one of them uses a history image they all have to be
+        // built for both images
+        m_passes.history.assign(m_passes.size(), 0);
+        for(auto p : m_executionOrder)
+        {
+            bool uses = m_passes.getHistoryInputs(p).size() > 0;
+            for(auto t : m_passes.getInputs(p))
+                uses = uses || m_targets.historyImage[t.index].valid();
+            for(auto t : m_passes.getOutputs(p))
+                uses = uses || m_targets.historyImage[t.index].valid();
+            m_passes.history[m_passes.renderPass[p.index].index] |= uses;
+        }
+        for(auto p : m_executionOrder)
+        {
+            m_passes.history[p.index] = m_passes.history[m_passes.renderPass[p.index].index];
+        }
 
-    std::vector<RenderTargetDefinition> inputSampledRenderTargets;  // input render targets
-    std::vector<RenderTargetDefinition> outputRenderTargets; // output render targets
-    uint32_t                            width  = 0; // if zer0, use swapchain's size
-    uint32_t                            height = 0;
+        _allocateBuffers(position, renderPassEnd);
 
-    RenderPassNode& input(std::string name)
-    {
-        inputSampledRenderTargets.push_back({name});
-        return *this;
+        _scheduleQueues();
     }
-    RenderPassNode& output(std::string name, FrameGraphFormat format=FrameGraphFormat::UNDEFINED)
+
+    /**
+     * @brief usesHistory
+     * @return
+     *
+     * Returns true if any pass reads a target with inputHistory( ).
+     * Executors then alternate between two versions of the passes
+     * which use history images. Only valid after finalize( )
+     */
+    bool usesHistory() const
     {
-        outputRenderTargets.push_back({name,format});
-        return *this;
+        return !m_passes.historyInputs.empty();
     }
-    RenderPassNode& setExtent(uint32_t _width, uint32_t _height)
+
+    /**
+     * @brief getImageAllocationInfo
+     * @return
+     *
+     * Returns the statistics of the image allocation performed
+     * by finalize( )
+     */
+    ImageAllocationInfo const & getImageAllocationInfo() const
     {
-        width = _width;
-        height = _height;
-        return *this;
+        return m_imageAllocationInfo;
     }
-};
-
 
+    /**
+     * @brief updateImageAllocationInfo
+     * @param swapchainWidth
+     * @param swapchainHeight
+     *
+     * Computes the peakImageBytes of the ImageAllocationInfo for the
+     * given swapchain size. finalize( ) calls this with 0x0, which only
+     * counts the images with a fixed extent, and the executors call it
+     * from resize( ) with the extent of their images. Imported images
+     * are not counted.
+     *
+     * This is the memory the images would need if the ones which are
+     * never alive at the same time shared memory, calculateImageByteSize( )
+     * is the memory they need when they do not.
+     */
+    void updateImageAllocationInfo(uint32_t swapchainWidth, uint32_t swapchainHeight)
+    {
+        // bytes which become alive/are released at each position
+        auto positions = m_executionOrder.size() + 1;
+        std::vector<uint64_t> allocated(positions, 0);
+        std::vector<uint64_t> released(positions, 0);
+        for(auto & I : m_images)
+        {
+            if(I.imported)
+                continue;
+            auto bytes = _imageByteSize(I, swapchainWidth, swapchainHeight);
+            allocated[I.firstUse]   += bytes;
+            released[I.lastUse + 1] += bytes;
+        }
 
-struct RenderTargetNode
-{
-    std::string              name;
-    std::string              writer;  // only one render pass can write to a render target
-    std::vector<std::string> readers; // multiple render passes can read from this render target
-
-    RenderTargetDefinition   imageResource;
-};
-
-using node_v = std::variant<RenderPassNode,RenderTargetNode>;
-
-struct FrameGraph
-{
-
-#define BE(A) std::begin(A),std::end(A)
+        uint64_t live = 0;
+        m_imageAllocationInfo.peakImageBytes = 0;
+        for(size_t i=0;i<positions;i++)
+        {
+            live = live + allocated[i] - released[i];
+            m_imageAllocationInfo.peakImageBytes = std::max(m_imageAllocationInfo.peakImageBytes, live);
+        }
+    }
 
     /**
-     * @brief findExecutionOrder
+     * @brief calculateImageByteSize
+     * @param swapchainWidth
+     * @param swapchainHeight
      * @return
      *
-     * Finds the execution order of the graph. This includes
-     * ALL nodes. This means it will include the render pass nodes
-     * and the render target nodes
+     * Returns the total number of bytes needed for all the images
+     * in the graph. Images which follow the swapchain's size
+     * use the swapchainWidth/swapchainHeight, times their scale.
+     * Multisampled images count every sample and mip chained
+     * images count every level.
      */
-    std::vector<std::string> findExecutionOrder() const
+    uint64_t calculateImageByteSize(uint32_t swapchainWidth, uint32_t swapchainHeight) const
     {
-        auto endNodes = findEndNodes();
-        std::vector<std::string> order;
-        for(auto & name : endNodes)
+        uint64_t total = 0;
+        for(auto & I : m_images)
         {
-            _recursePushBack(name, order);
+            if(I.imported)
+                continue;
+            total += _imageByteSize(I, swapchainWidth, swapchainHeight);
         }
+        return total;
+    }
 
-        std::reverse(BE(order));
-        std::unordered_set<std::string> seen;
-        auto it = std::remove_if(BE(order),[&seen](auto & x)
-        {
-           return seen.insert(x).second == false;
-        });
-        order.erase(it, order.end());
-        return order;
+    /**
+     * @brief findPass
+     * @param name
+     * @return
+     *
+     * Returns the handle to the pass with the given name, or an
+     * invalid handle if it does not exist.
+     */
+    PassHandle findPass(std::string const & name) const
+    {
+        auto it = m_passLookup.find(name);
+        return it == m_passLookup.end() ? PassHandle{} : it->second;
     }
 
     /**
-     * @brief createRenderPass
+     * @brief findTarget
      * @param name
      * @return
      *
-     * Create a renderPass and return the reference to it.
+     * Returns the handle to the render target with the given name, or an
+     * invalid handle if it does not exist. Only valid after finalize( )
      */
-    RenderPassNode& createRenderPass(std::string const & name)
+    TargetHandle findTarget(std::string const & name) const
     {
-        RenderPassNode RPN;
-        RPN.name = name;
-        m_nodes[name] = RPN;
-        return std::get<RenderPassNode>(m_nodes[name]);
+        auto it = m_targetLookup.find(name);
+        return it == m_targetLookup.end() ? TargetHandle{} : it->second;
     }
 
     /**
-     * @brief finalize
+     * @brief findBuffer
+     * @param name
+     * @return
      *
-     * Call this function after the graph has been generated.
-     * This will determine the order the render passes should
-     * be executed in as well as determine how many images
-     * should be created and which ones should be reused
+     * Returns the handle to the buffer with the given name, or an
+     * invalid handle if it does not exist. Only valid after finalize( )
      */
-    void finalize()
+    BufferHandle findBuffer(std::string const & name) const
+    {
+        auto it = m_bufferLookup.find(name);
+        return it == m_bufferLookup.end() ? BufferHandle{} : it->second;
+    }
+
+    /**
+     * @brief getExecutionOrder
+     * @return
+     *
+     * Returns the order the passes were determined to be executed
+     * in when finalize( ) was called.
+     */
+    std::vector<PassHandle> const & getExecutionOrder() const
+    {
+        return m_executionOrder;
+    }
+
+    std::vector<ImageDefinition> const & getImages() const
+    {
+        return m_images;
+    }
+    PassTable const & getPasses() const
+    {
+        return m_passes;
+    }
+    TargetTable const & getTargets() const
+    {
+        return m_targets;
+    }
+    std::vector<BufferDefinition> const & getBuffers() const
+    {
+        return m_buffers;
+    }
+    BufferTable const & getBufferTable() const
+    {
+        return m_bufferTable;
+    }
+    std::vector<QueueBatch> const & getQueueBatches() const
+    {
+        return m_queueBatches;
+    }
+    RenderPassNode const & getPassDeclaration(PassHandle p) const
+    {
+        return m_passDecls.at(p.index);
+    }
+protected:
+
+    /**
+     * Merges adjacent passes in the execution order into a single render
+     * pass. A pass is merged into the render pass before it if:
+     *
+     *  - both are graphics passes rendering to images with the same extent
+ *    and sample count
+     *  - it reads at least one target written by the render pass
+     *  - every target it reads from the render pass is an inputAttachment( )
+     *  - it does not read a buffer written by the render pass
+     */
+    void _mergeRenderPasses()
     {
-        for(auto it=m_nodes.begin();it!=m_nodes.end();)
+        m_passes.renderPass.assign(m_passes.size(), {});
+        m_passes.subpass.assign(m_passes.size(), 0);
+        m_passes.subpassInput.assign(m_passes.inputs.size(), 0);
+
+        for(uint32_t i=0;i<m_executionOrder.size();i++)
         {
-            if( std::holds_alternative<RenderTargetNode>(it->second) )
+            auto p = m_executionOrder[i];
+            m_passes.renderPass[p.index] = p;
+
+            if(i == 0)
+                continue;
+
+            auto prev = m_executionOrder[i-1];
+            auto rp   = m_passes.renderPass[prev.index];
+
+            if( m_passes.getOutputs(p).empty() || m_passes.getOutputs(rp).empty() )
+                continue;
+            if( m_passes.type[p.index] != PassType::GRAPHICS || m_passes.type[rp.index] != PassType::GRAPHICS )
+                continue;
+            if( m_passes.width[p.index]  != m_passes.width[rp.index] ||
+                m_passes.height[p.index] != m_passes.height[rp.index] ||
+                m_passes.scale[p.index]  != m_passes.scale[rp.index] ||
+                m_passes.samples[p.index] != m_passes.samples[rp.index])
+                continue;
+
+            // passes which render to a mip level have the extent of the mip
+            auto _writesMip = [&](PassHandle q)
+            {
+                for(auto t : m_passes.getOutputs(q))
+                    if(m_targets.mip[t.index] != 0)
+                        return true;
+                return false;
+            };
+            if( _writesMip(p) || _writesMip(rp) )
+                continue;
+
+            bool merge = false;
+            auto first = m_passes.inputOffset[p.index];
+            for(uint32_t k=first; k<m_passes.inputOffset[p.index+1]; k++)
             {
-                it = m_nodes.erase(it);
+                auto w = m_targets.writer[m_passes.inputs[k].index];
+                if(!w.valid() || m_passes.renderPass[w.index] != rp)
+                    continue;
+
+                merge = m_passes.inputType[k] == InputType::ATTACHMENT;
+                if(!merge)
+                    break;
             }
-            else
+            for(auto b : m_passes.getInputBuffers(p))
+            {
+                merge = merge && m_passes.renderPass[m_bufferTable.writer[b.index].index] != rp;
+            }
+            if(!merge)
+                continue;
+
+            m_passes.renderPass[p.index] = rp;
+            m_passes.subpass[p.index]    = m_passes.subpass[prev.index] + 1;
+            for(uint32_t k=first; k<m_passes.inputOffset[p.index+1]; k++)
+            {
+                auto w = m_targets.writer[m_passes.inputs[k].index];
+                m_passes.subpassInput[k] = w.valid() && m_passes.renderPass[w.index] == rp;
+            }
+        }
+    }
+
+    /**
+     * The number of bytes of a single image, every sample of every
+     * mip level. A 0x0 swapchain gives images sized to it 0 bytes.
+     */
+    static uint64_t _imageByteSize(ImageDefinition const & I, uint32_t swapchainWidth, uint32_t swapchainHeight)
+    {
+        uint64_t w = I.width * I.height == 0 ? scaleExtent(swapchainWidth,  I.scale) : I.width;
+        uint64_t h = I.width * I.height == 0 ? scaleExtent(swapchainHeight, I.scale) : I.height;
+        if(w * h == 0)
+            return 0;
+        uint64_t texels = 0;
+        for(uint32_t k=0;k<I.mipLevels;k++)
+        {
+            texels += std::max<uint64_t>(w >> k, 1) * std::max<uint64_t>(h >> k, 1);
+        }
+        return texels * formatByteSize(I.format) * I.samples;
+    }
+
+    /**
+     * Works out the lifetime of every buffer and assigns them to
+     * BufferDefinitions. Like render targets, buffers used by a merged
+     * render pass are alive for the whole render pass.
+     */
+    void _allocateBuffers(std::vector<uint32_t> const & position, std::vector<uint32_t> const & renderPassEnd)
+    {
+        auto bufferCount = static_cast<uint32_t>(m_bufferTable.size());
+
+        m_bufferTable.firstUse.resize(bufferCount);
+        m_bufferTable.lastUse.resize(bufferCount);
+
+        std::vector<uint32_t> sortedBuffers(bufferCount);
+        for(uint32_t b=0;b<bufferCount;b++)
+        {
+            auto rp   = m_passes.renderPass[m_bufferTable.writer[b].index];
+            auto last = renderPassEnd[rp.index];
+            for(auto r : m_bufferTable.getReaders({b}))
             {
-                it++;
+                last = std::max(last, renderPassEnd[m_passes.renderPass[r.index].index]);
             }
+            m_bufferTable.firstUse[b] = position[rp.index];
+            m_bufferTable.lastUse[b]  = last;
+            sortedBuffers[b]          = b;
         }
-        generateImages();
 
-        auto order = findExecutionOrder();
+        std::sort(sortedBuffers.begin(), sortedBuffers.end(), [&](uint32_t a, uint32_t b)
+        {
+            return std::tie(m_bufferTable.firstUse[a], a) < std::tie(m_bufferTable.firstUse[b], b);
+        });
+
+        using active_type = std::pair<uint32_t, BufferAllocationHandle>; // lastUse, buffer
 
-        GFG_INFO("Execute Order: {}", fmt::join(BE(order),","));
+        // buffers which are not in use, grouped by size
+        std::map<uint64_t, std::vector<BufferAllocationHandle>> freeBuffers;
 
-        std::map<std::string, int32_t> imageUseCount;
+        // buffers which are in use, ordered by when they will be released
+        std::priority_queue<active_type, std::vector<active_type>, std::greater<active_type>> activeBuffers;
 
-        auto _print = [&]()
+        for(auto b : sortedBuffers)
         {
-            for(auto & [rtName, count] : imageUseCount)
+            auto first = m_bufferTable.firstUse[b];
+
+            while(!activeBuffers.empty() && activeBuffers.top().first < first)
+            {
+                auto buf = activeBuffers.top().second;
+                freeBuffers[ m_buffers[buf.index].size ].push_back(buf);
+                activeBuffers.pop();
+            }
+
+            auto & available = freeBuffers[ m_bufferTable.byteSize[b] ];
+            if(available.empty())
+            {
+                BufferDefinition bufDef;
+                bufDef.name     = m_bufferTable.name[b] + "_buf";
+                bufDef.size     = m_bufferTable.byteSize[b];
+                bufDef.usage    = m_bufferTable.usage[b];
+                bufDef.firstUse = first;
+
+                m_bufferTable.allocation[b].index = static_cast<uint32_t>(m_buffers.size());
+                m_buffers.push_back(bufDef);
+            }
+            else
             {
-                GFG_INFO("{} : {}   {}", rtName, count, std::get<RenderTargetNode>(m_nodes.at(rtName)).imageResource.name);
+                m_bufferTable.allocation[b] = available.back();
+                available.pop_back();
             }
-            GFG_INFO("----");
+            auto & B = m_buffers[m_bufferTable.allocation[b].index];
+            B.lastUse = m_bufferTable.lastUse[b];
+            B.usage  |= m_bufferTable.usage[b];
+
+            activeBuffers.push({m_bufferTable.lastUse[b], m_bufferTable.allocation[b]});
+
+            GFG_INFO("Buffer: {} [{}, {}] -> {}", m_bufferTable.name[b], first, m_bufferTable.lastUse[b], B.name);
+        }
+    }
+
+    /**
+     * Splits the execution order into batches for the graphics and
+     * compute queues. A pass which accesses an image or buffer that was
+     * last accessed by the other queue has to wait for the pass which
+     * accessed it, so the batch containing that pass ends after it.
+     * Waiting for a batch also waits for all the batches submitted
+     * before it on the same queue, so a queue only waits when it needs
+     * a later pass than it has already waited for.
+     *
+     * The execution order is walked twice so that accesses at the end
+     * of the previous frame are waited for as well. Passes merged into
+     * a render pass stay in the batch of the first pass, their waits
+     * are moved to the start of that batch.
+     */
+    void _scheduleQueues()
+    {
+        constexpr uint32_t none = QueueBatch::noWait;
 
+        auto passCount     = static_cast<uint32_t>(m_executionOrder.size());
+        auto imageCount    = static_cast<uint32_t>(m_images.size());
+        auto resourceCount = imageCount + static_cast<uint32_t>(m_buffers.size());
+
+        // all the images and buffers a pass accesses, buffers
+        // are numbered after the images. Both images of a history
+        // target are used, as they swap every frame.
+        auto _forEachTarget = [&](TargetHandle t, auto && f)
+        {
+            f(m_targets.image[t.index].index);
+            if(m_targets.historyImage[t.index].valid())
+                f(m_targets.historyImage[t.index].index);
         };
-        _print();
+        auto _forEachResource = [&](PassHandle p, auto && f)
+        {
+            for(auto t : m_passes.getInputs(p))
+                _forEachTarget(t, f);
+            for(auto t : m_passes.getOutputs(p))
+                _forEachTarget(t, f);
+            for(auto t : m_passes.getHistoryInputs(p))
+                _forEachTarget(t, f);
+            for(auto b : m_passes.getInputBuffers(p))
+                f(imageCount + m_bufferTable.allocation[b.index].index);
+            for(auto b : m_passes.getOutputBuffers(p))
+                f(imageCount + m_bufferTable.allocation[b.index].index);
+        };
+
+        // the last position of each queue which accessed each resource, and
+        // whether it was accessed by the queue in the previous frame
+        std::vector<uint32_t> lastAccess(resourceCount*2, none);
+        std::vector<uint8_t>  previousFrame(resourceCount*2, 0);
+
+        // per position in the execution order
+        std::vector<uint32_t> need(passCount);     // the last position on the other queue it waits for
+        std::vector<uint8_t>  needPrev(passCount); // it waits for the other queue's previous frame
+        std::vector<uint8_t>  endsBatch(passCount);
+        std::vector<uint32_t> batchOf(passCount);
 
+        m_passes.batch.assign(m_passes.size(), 0);
 
-        for(auto & name : order)
+        for(uint32_t iteration=0; iteration<2; iteration++)
         {
-            auto & n = m_nodes.at(name);
-            if( std::holds_alternative<RenderPassNode>(n) )
+            for(size_t k=0;k<lastAccess.size();k++)
             {
-                auto & N = std::get<RenderPassNode>(n);
-                for(auto & n : N.outputRenderTargets)
+                previousFrame[k] |= lastAccess[k] != none;
+                lastAccess[k]     = none;
+            }
+            std::fill(endsBatch.begin(), endsBatch.end(), 0);
+
+            for(uint32_t i=0;i<passCount;i++)
+            {
+                auto p = m_executionOrder[i];
+                auto q = static_cast<uint32_t>(m_passes.queue[p.index]);
+                auto o = 1 - q;
+
+                need[i]     = none;
+                needPrev[i] = 0;
+                _forEachResource(p, [&](uint32_t r)
                 {
-                    imageUseCount[n.name]++;
-                }
-                for(auto & n : N.inputSampledRenderTargets)
+                    auto j = lastAccess[r*2+o];
+                    if(j != none)
+                        need[i] = need[i] == none ? j : std::max(need[i], j);
+                    else if(previousFrame[r*2+o])
+                        needPrev[i] = 1;
+                });
+                _forEachResource(p, [&](uint32_t r)
                 {
-                    imageUseCount[n.name]++;
-                }
+                    lastAccess[r*2+q]    = i;
+                    previousFrame[r*2+q] = 0;
+                });
+                if(need[i] != none)
+                    endsBatch[need[i]] = 1;
             }
-        }
 
-        for(auto & name : order)
-        {
-            auto & _n = m_nodes.at(name);
-            if( !std::holds_alternative<RenderPassNode>(_n))
-                continue;
-            auto & N = std::get<RenderPassNode>(_n);
+            m_queueBatches.clear();
 
-            GFG_INFO("Pass Name: {}", name);
+            uint32_t open[2]       = {none, none}; // the batch each queue is adding passes to
+            uint32_t waited[2]     = {none, none}; // the last position each queue has waited for
+            bool     waitedPrev[2] = {false, false};
+            uint32_t batchCount[2] = {0, 0};
 
-            for(auto & outTarget : N.outputRenderTargets)
+            for(uint32_t i=0;i<passCount;i++)
             {
-                auto & outRenderTarget = std::get<RenderTargetNode>(m_nodes.at(outTarget.name));
-                auto imageThatIsNotBeingUsed = _findImageThatIsNotBeingUsed(imageUseCount, N, outTarget);
+                auto p = m_executionOrder[i];
+                auto q = static_cast<uint32_t>(m_passes.queue[p.index]);
+
+                // waiting for any pass of this frame also waits for the previous frame
+                auto wait = need[i];
+                if(wait != none && waited[q] != none && wait <= waited[q])
+                    wait = none;
+                bool prev = needPrev[i] && wait == none && waited[q] == none && !waitedPrev[q];
 
-                if(imageThatIsNotBeingUsed.empty()) // no available image
+                if(open[q] == none || ((wait != none || prev) && m_passes.subpass[p.index] == 0))
                 {
-                    // generate new image
-                    auto imageName =  outTarget.name + "_img";//  fmt::format("{}_img", outTarget.name);
-                    outRenderTarget.imageResource.name   = imageName;
-                    outRenderTarget.imageResource.format = outTarget.format;
-
-                    ImageDefinition imgDef;
-                    imgDef.name   = imageName;
-                    imgDef.format = outTarget.format;
-                    imgDef.width  = N.width;
-                    imgDef.height = N.height;
-
-                    m_images[imageName] = imgDef;
+                    open[q] = static_cast<uint32_t>(m_queueBatches.size());
+                    auto & B = m_queueBatches.emplace_back();
+                    B.queue        = m_passes.queue[p.index];
+                    B.indexInQueue = batchCount[q]++;
                 }
-                else
+
+                auto & B = m_queueBatches[open[q]];
+                if(wait != none)
                 {
-                    outRenderTarget.imageResource.name = std::get<RenderTargetNode>(m_nodes.at(imageThatIsNotBeingUsed)).imageResource.name;
-                    imageUseCount.at(imageThatIsNotBeingUsed)++;
+                    B.wait    = B.wait == none ? batchOf[wait] : std::max(B.wait, batchOf[wait]);
+                    waited[q] = wait;
+                }
+                if(prev)
+                {
+                    B.waitPreviousFrame = true;
+                    waitedPrev[q]       = true;
                 }
-            }
 
-            _print();
+                B.passes.push_back(i);
+                batchOf[i]              = open[q];
+                m_passes.batch[p.index] = open[q];
 
-            for(auto & outTarget : N.outputRenderTargets)
-            {
-                imageUseCount.at(outTarget.name)--;
+                // the other queue waits for this pass. A render pass
+                // can't be split, so the batch ends after its last subpass
+                if(endsBatch[i] && i+1 < passCount && m_passes.subpass[m_executionOrder[i+1].index] > 0)
+                    endsBatch[i+1] = 1;
+                else if(endsBatch[i])
+                    open[q] = none;
             }
-            for(auto & inTarget : N.inputSampledRenderTargets)
+        }
+
+        // resources used by the compute queue are shared between queues
+        for(auto p : m_executionOrder)
+        {
+            if(m_passes.queue[p.index] != QueueType::COMPUTE)
+                continue;
+            _forEachResource(p, [&](uint32_t r)
             {
-                imageUseCount.at(inTarget.name)--;
-            }
+                if(r < imageCount)
+                    m_images[r].asyncCompute = true;
+                else
+                    m_buffers[r - imageCount].asyncCompute = true;
+            });
         }
     }
 
-
-    auto const & getImages() const
-    {
-        return m_images;
-    }
-    auto const & getNodes() const
+    void _compile()
     {
-        return m_nodes;
-    }
-protected:
+        m_passes  = {};
+        m_targets = {};
+        m_bufferTable = {};
+        m_images.clear();
+        m_buffers.clear();
+        m_executionOrder.clear();
+        m_targetLookup.clear();
+        m_bufferLookup.clear();
 
-    // finds all nodes that do not have outputs
-    std::vector<std::string> findEndNodes() const
-    {
-        // end node will always be a RenderTarget
+        auto passCount = static_cast<uint32_t>(m_passDecls.size());
+
+        // imported targets have no writer unless a pass outputs to them
+        for(auto & I : m_imports)
+        {
+            auto & t = m_targetLookup[I.name];
+            t.index = static_cast<uint32_t>(m_targets.size());
+            m_targets.name.push_back(I.name);
+            m_targets.format.push_back(I.format);
+            m_targets.writer.emplace_back();
+            m_targets.image.emplace_back();
+            m_targets.imported.push_back(1);
+            m_targets.mip.push_back(0);
+            m_targets.samples.push_back(1);
+        }
 
-        std::vector<std::string> endNodes;
-        for(auto & [name, n] : m_nodes)
+        // first generate all the render targets.
+        // go through each of the passes and create the output
+        // render targets. Only one pass can write to a target
+        std::vector<std::string> mipBaseName;
+        for(uint32_t p=0;p<passCount;p++)
         {
-            if(std::holds_alternative<RenderTargetNode>(n))
+            for(auto & o : m_passDecls[p].outputRenderTargets)
             {
-                auto & N = std::get<RenderTargetNode>(n); // should always be a render pass node
-                if(N.readers.size() == 0)
-                    endNodes.push_back(name);
+                auto   name = mipTargetName(o.name, o.mip);
+                auto & t    = m_targetLookup[name];
+                if(!t.valid())
+                {
+                    t.index = static_cast<uint32_t>(m_targets.size());
+                    m_targets.name.push_back(name);
+                    m_targets.format.push_back(o.format);
+                    m_targets.writer.push_back({p});
+                    m_targets.image.emplace_back();
+                    m_targets.imported.push_back(0);
+                    m_targets.mip.push_back(o.mip);
+                    m_targets.samples.push_back(o.samples);
+                    mipBaseName.resize(m_targets.size());
+                    mipBaseName.back() = o.name;
+                }
+                else if(!m_targets.writer[t.index].valid())
+                {
+                    if(o.samples > 1)
+                        throw std::invalid_argument("FrameGraph cannot render multisampled to imported render target: " + o.name);
+                    m_targets.writer[t.index] = {p};
+                }
             }
-            else
+            for(auto & o : m_passDecls[p].outputBuffers)
             {
-                auto & N = std::get<RenderPassNode>(n); // should always be a render pass node
-                if(N.outputRenderTargets.size() == 0)
-                    endNodes.push_back(name);
+                auto & b = m_bufferLookup[o.name];
+                if(!b.valid())
+                {
+                    b.index = static_cast<uint32_t>(m_bufferTable.size());
+                    m_bufferTable.name.push_back(o.name);
+                    m_bufferTable.byteSize.push_back(o.size);
+                    m_bufferTable.usage.push_back(o.usage);
+                    m_bufferTable.writer.push_back({p});
+                    m_bufferTable.allocation.emplace_back();
+                }
             }
+        }
 
+        // Multisampled targets which are read are given a resolve
+        // target, written by the same pass. Readers read the resolve.
+        m_targets.resolve.resize(m_targets.size());
+        m_targets.resolveSource.resize(m_targets.size());
+        for(auto & D : m_passDecls)
+        {
+            for(auto * inputs : {&D.inputSampledRenderTargets, &D.inputAttachmentRenderTargets, &D.inputStorageRenderTargets, &D.inputHistoryRenderTargets})
+            {
+                for(auto & i : *inputs)
+                {
+                    auto it = m_targetLookup.find(mipTargetName(i.name, i.mip));
+                    if(it == m_targetLookup.end())
+                        continue;
+                    auto s = it->second;
+                    if(m_targets.samples[s.index] == 1 || m_targets.resolve[s.index].valid())
+                        continue;
+                    if(isDepth(m_targets.format[s.index]))
+                        throw std::invalid_argument("FrameGraph cannot resolve multisampled depth render target: " + i.name);
 
+                    auto   name = resolveTargetName(m_targets.name[s.index]);
+                    auto & r    = m_targetLookup[name];
+                    r.index = static_cast<uint32_t>(m_targets.size());
+                    m_targets.name.push_back(name);
+                    m_targets.format.push_back(m_targets.format[s.index]);
+                    m_targets.writer.push_back(m_targets.writer[s.index]);
+                    m_targets.image.emplace_back();
+                    m_targets.imported.push_back(0);
+                    m_targets.mip.push_back(0);
+                    m_targets.samples.push_back(1);
+                    m_targets.resolve.emplace_back();
+                    m_targets.resolveSource.push_back(s);
+                    m_targets.resolve[s.index] = r;
+                }
+            }
         }
-        return endNodes;
-    }
 
+        auto _getTarget = [&](std::string const & name)
+        {
+            auto it = m_targetLookup.find(name);
+            if(it == m_targetLookup.end())
+                throw std::out_of_range("FrameGraph render target is never written to: " + name);
+            return it->second;
+        };
 
-    void _recursePushBack(std::string const & name, std::vector<std::string> & order) const
-    {
-        auto & n = m_nodes.at(name);
-        order.push_back(name);
+        // readers of a multisampled target read its resolve
+        auto _readTarget = [&](std::string const & name)
+        {
+            auto t = _getTarget(name);
+            return m_targets.resolve[t.index].valid() ? m_targets.resolve[t.index] : t;
+        };
 
-        if(std::holds_alternative<RenderPassNode>(n))
+        // the mip levels of a target are rendered into the image of its mip 0
+        mipBaseName.resize(m_targets.size());
+        m_targets.baseMip.resize(m_targets.size());
+        for(uint32_t t=0;t<m_targets.size();t++)
         {
-            auto & N = std::get<RenderPassNode>(n); // should always be a render pass node
-            for(auto & in : N.inputSampledRenderTargets)
-            {
-                _recursePushBack(in.name, order);
-            }
+            m_targets.baseMip[t] = {t};
+            if(m_targets.mip[t] == 0)
+                continue;
+
+            auto it = m_targetLookup.find(mipBaseName[t]);
+            if(it == m_targetLookup.end())
+                throw std::invalid_argument("FrameGraph mip 0 of render target is never written to: " + mipBaseName[t]);
+            if(m_targets.imported[it->second.index])
+                throw std::invalid_argument("FrameGraph cannot render to the mip levels of imported render target: " + mipBaseName[t]);
+            m_targets.baseMip[t] = it->second;
         }
-        else if(std::holds_alternative<RenderTargetNode>(n))
+        auto _getBuffer = [&](std::string const & name)
         {
-            auto & N = std::get<RenderTargetNode>(n); // should always be a render pass node
-            assert(!N.writer.empty());
-            _recursePushBack(N.writer, order);
-        }
+            auto it = m_bufferLookup.find(name);
+            if(it == m_bufferLookup.end())
+                throw std::out_of_range("FrameGraph buffer is never written to: " + name);
+            return it->second;
+        };
 
-    }
+        m_passes.inputOffset.reserve(passCount+1);
+        m_passes.outputOffset.reserve(passCount+1);
+        m_passes.inputBufferOffset.reserve(passCount+1);
+        m_passes.outputBufferOffset.reserve(passCount+1);
+        m_passes.historyInputOffset.reserve(passCount+1);
+        m_targets.historyImage.resize(m_targets.size());
 
-    // returns the name of the render target which
-    // has an image but is no longer being used
-    std::string _findImageThatIsNotBeingUsed(std::map<std::string, int32_t> & renderTargetUsageCount,
-                                            RenderPassNode const & node,
-                                            RenderTargetDefinition const & def)
-    {
-        for(auto & [name, count] : renderTargetUsageCount)
+        std::vector<uint32_t> readerCount(m_targets.size(), 0);
+        std::vector<uint32_t> bufferReaderCount(m_bufferTable.size(), 0);
+        for(uint32_t p=0;p<passCount;p++)
         {
-            if(count == 0) // image isn't being used
+            auto & D = m_passDecls[p];
+            m_passes.name.push_back(D.name);
+            m_passes.type.push_back(D.type);
+            m_passes.queue.push_back(D.type == PassType::COMPUTE ? D.queue : QueueType::GRAPHICS);
+            m_passes.width.push_back(D.width);
+            m_passes.height.push_back(D.height);
+            m_passes.scale.push_back(D.width * D.height == 0 ? D.scale : 1.0f);
+
+            m_passes.inputOffset.push_back(static_cast<uint32_t>(m_passes.inputs.size()));
+            for(auto & i : D.inputSampledRenderTargets)
+            {
+                auto t = _readTarget(mipTargetName(i.name, i.mip));
+                m_passes.inputs.push_back(t);
+                m_passes.inputType.push_back(InputType::SAMPLED);
+                m_passes.inputSampler.push_back(i.sampler);
+                readerCount[t.index]++;
+            }
+            for(auto & i : D.inputAttachmentRenderTargets)
+            {
+                auto t = _readTarget(i.name);
+                m_passes.inputs.push_back(t);
+                m_passes.inputType.push_back(InputType::ATTACHMENT);
+                m_passes.inputSampler.push_back({});
+                readerCount[t.index]++;
+            }
+            for(auto & i : D.inputStorageRenderTargets)
             {
-                auto & N = std::get<RenderTargetNode>(m_nodes.at(name));
+                auto t = _readTarget(i.name);
+                m_passes.inputs.push_back(t);
+                m_passes.inputType.push_back(InputType::STORAGE);
+                m_passes.inputSampler.push_back({});
+                readerCount[t.index]++;
+            }
 
-                auto & I = m_images.at(N.imageResource.name);
-                if( std::tie(I.format,I.height,I.width) == std::tie(def.format,node.width,node.height) )
-                {
-                    return name;
-                }
-                //return name;
+            m_passes.outputOffset.push_back(static_cast<uint32_t>(m_passes.outputs.size()));
+            uint32_t samples = 0;
+            for(auto & o : D.outputRenderTargets)
+            {
+                auto t = _getTarget(mipTargetName(o.name, o.mip));
+                if(samples != 0 && samples != m_targets.samples[t.index])
+                    throw std::invalid_argument("FrameGraph pass renders to targets with different sample counts: " + D.name);
+                samples = m_targets.samples[t.index];
+
+                m_passes.outputs.push_back(t);
+                if(m_targets.resolve[t.index].valid())
+                    m_passes.outputs.push_back(m_targets.resolve[t.index]);
             }
-        }
-        return "";
-    }
+            m_passes.samples.push_back(std::max(samples, 1u));
 
-    // generate all the image nodes based on
-    // the render target outputs.
-    void generateImages()
-    {
-        std::map<std::string, RenderTargetNode> images;
+            m_passes.inputBufferOffset.push_back(static_cast<uint32_t>(m_passes.inputBuffers.size()));
+            for(auto & i : D.inputBuffers)
+            {
+                auto b = _getBuffer(i.name);
+                m_passes.inputBuffers.push_back(b);
+                bufferReaderCount[b.index]++;
+            }
 
-        // first generate all the output images
-        // go through each of the nodes and create the output
-        // render target descriptions
-        for(auto & [name,n] : m_nodes)
-        {
-            auto & N = std::get<RenderPassNode>(n);
-            for(auto & o : N.outputRenderTargets)
+            m_passes.outputBufferOffset.push_back(static_cast<uint32_t>(m_passes.outputBuffers.size()));
+            for(auto & o : D.outputBuffers)
             {
-                if( images.count(o.name) == 0)
-                {
-                    auto & nI = images[o.name];
-                    nI.name   = o.name;
-                    nI.writer = name;
-                }
+                m_passes.outputBuffers.push_back(_getBuffer(o.name));
+            }
+
+            m_passes.historyInputOffset.push_back(static_cast<uint32_t>(m_passes.historyInputs.size()));
+            for(auto & i : D.inputHistoryRenderTargets)
+            {
+                auto t = _readTarget(i.name);
+                if(!m_targets.writer[t.index].valid() || m_targets.imported[t.index])
+                    throw std::invalid_argument("FrameGraph cannot keep the history of imported render target: " + i.name);
+                m_passes.historyInputs.push_back(t);
+                m_passes.historyInputSampler.push_back(i.sampler);
             }
         }
+        m_passes.inputOffset.push_back(static_cast<uint32_t>(m_passes.inputs.size()));
+        m_passes.outputOffset.push_back(static_cast<uint32_t>(m_passes.outputs.size()));
+        m_passes.inputBufferOffset.push_back(static_cast<uint32_t>(m_passes.inputBuffers.size()));
+        m_passes.outputBufferOffset.push_back(static_cast<uint32_t>(m_passes.outputBuffers.size()));
+        m_passes.historyInputOffset.push_back(static_cast<uint32_t>(m_passes.historyInputs.size()));
 
-        // Tell each of new new images we created
-        // which render pass is reading from it
-        for(auto & n : m_nodes)
+        // Tell each of the targets which passes are reading from it
+        m_targets.readerOffset.resize(m_targets.size()+1, 0);
+        for(uint32_t t=0;t<m_targets.size();t++)
         {
-            auto & N = std::get<RenderPassNode>(n.second);
-            for(auto & in : N.inputSampledRenderTargets)
+            m_targets.readerOffset[t+1] = m_targets.readerOffset[t] + readerCount[t];
+        }
+        m_targets.readers.resize(m_passes.inputs.size());
+
+        std::fill(readerCount.begin(), readerCount.end(), 0);
+        for(uint32_t p=0;p<passCount;p++)
+        {
+            for(auto t : m_passes.getInputs({p}))
             {
-                images.at(in.name).readers.push_back(n.first);
+                m_targets.readers[ m_targets.readerOffset[t.index] + readerCount[t.index]++ ] = {p};
             }
         }
 
-        // copy all the image nodes into
-        // node list
-        for(auto & [n,i] : images)
+        // and the same for the buffers
+        m_bufferTable.readerOffset.resize(m_bufferTable.size()+1, 0);
+        for(uint32_t b=0;b<m_bufferTable.size();b++)
+        {
+            m_bufferTable.readerOffset[b+1] = m_bufferTable.readerOffset[b] + bufferReaderCount[b];
+        }
+        m_bufferTable.readers.resize(m_passes.inputBuffers.size());
+
+        std::fill(bufferReaderCount.begin(), bufferReaderCount.end(), 0);
+        for(uint32_t p=0;p<passCount;p++)
         {
-            m_nodes[n] = i;
+            for(auto b : m_passes.getInputBuffers({p}))
+            {
+                m_bufferTable.readers[ m_bufferTable.readerOffset[b.index] + bufferReaderCount[b.index]++ ] = {p};
+            }
         }
     }
 
-//public:
+    // the declarations, this is what the user creates.
+    // A deque is used so that references returned by
+    // createRenderPass( ) are not invalidated.
+    std::deque<RenderPassNode>                    m_passDecls;
+    std::unordered_map<std::string, PassHandle>   m_passLookup;
+    std::vector<ImportedTargetDefinition>         m_imports;
 
-    std::map< std::string, ImageDefinition> m_images;
-    std::map<std::string, node_v>           m_nodes;
-#undef BE
+    // the compiled graph
+    PassTable                                     m_passes;
+    TargetTable                                   m_targets;
+    std::vector<ImageDefinition>                  m_images;
+    std::vector<PassHandle>                       m_executionOrder;
+    std::unordered_map<std::string, TargetHandle> m_targetLookup;
+    ImageAllocationInfo                           m_imageAllocationInfo;
+    BufferTable                                   m_bufferTable;
+    std::vector<BufferDefinition>                 m_buffers;
+    std::unordered_map<std::string, BufferHandle> m_bufferLookup;
+    std::vector<QueueBatch>                       m_queueBatches;
 };
 
 }
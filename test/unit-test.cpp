@@ -1,5 +1,8 @@
 #include <catch2/catch.hpp>
+#include <cstdlib>
+#include <new>
 #include <frameGraph/frameGraph.h>
+#include <frameGraph/executors/ExecutorBase.h>
 
 SCENARIO("test")
 {
@@ -19,11 +22,1264 @@ SCENARIO("test")
     G.finalize();
 
 
-    auto & geometryPass = std::get<RenderPassNode>(G.getNodes().at("geometryPass"));
-    auto & Final = std::get<RenderPassNode>(G.getNodes().at("Final"));
-    auto & C1 = std::get<RenderTargetNode>(G.getNodes().at("C1"));
-    auto & D1 = std::get<RenderTargetNode>(G.getNodes().at("D1"));
+    auto geometryPass = G.findPass("geometryPass");
+    auto Final        = G.findPass("Final");
+    auto C1           = G.findTarget("C1");
+    auto D1           = G.findTarget("D1");
+
+    REQUIRE( geometryPass.valid() );
+    REQUIRE( Final.valid() );
+    REQUIRE( C1.valid() );
+    REQUIRE( D1.valid() );
 
     //C1.imageResource.
     //rC1.inputRenderTargets.at(0).name
 }
+
+SCENARIO("Execution order places producers before consumers")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("geometryPass")
+     .output("C1", FrameGraphFormat::R8G8B8A8_UNORM)
+     .output("D1", FrameGraphFormat::D32_SFLOAT);
+
+    G.createRenderPass("HBlur1")
+     .setExtent(256,256)
+     .input("C1")
+     .output("B1h", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("VBlur1")
+     .setExtent(256,256)
+     .input("B1h")
+     .output("B1v",FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("Final")
+     .input("B1v")
+     .input("C1");
+
+    G.finalize();
+
+    auto & order = G.getExecutionOrder();
+
+    auto pos = [&](std::string const & n)
+    {
+        return std::distance(order.begin(), std::find(order.begin(), order.end(), G.findPass(n)));
+    };
+
+    REQUIRE( order.size() == G.getPasses().size() );
+    REQUIRE( pos("geometryPass") < pos("HBlur1") );
+    REQUIRE( pos("HBlur1")       < pos("VBlur1") );
+    REQUIRE( pos("VBlur1")       < pos("Final") );
+}
+
+SCENARIO("Passes are grouped into dependency levels")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("geometryPass")
+     .output("C1", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("shadowPass")
+     .output("S1", FrameGraphFormat::D32_SFLOAT);
+
+    G.createRenderPass("HBlur1")
+     .input("C1")
+     .output("B1h", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("Final")
+     .input("B1h")
+     .input("S1");
+
+    G.finalize();
+
+    auto & level = G.getPasses().level;
+
+    REQUIRE( level[G.findPass("geometryPass").index] == 0 );
+    REQUIRE( level[G.findPass("shadowPass").index]   == 0 );
+    REQUIRE( level[G.findPass("HBlur1").index]       == 1 );
+    REQUIRE( level[G.findPass("Final").index]        == 2 );
+}
+
+SCENARIO("Compiled graph stores edges as handles")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    auto geometryPass = G.createRenderPass("geometryPass")
+                         .output("C1", FrameGraphFormat::R8G8B8A8_UNORM)
+                         .output("D1", FrameGraphFormat::D32_SFLOAT)
+                         .getHandle();
+
+    auto Final = G.createRenderPass("Final")
+                  .input("C1")
+                  .input("D1")
+                  .getHandle();
+
+    G.finalize();
+
+    auto & passes  = G.getPasses();
+    auto & targets = G.getTargets();
+
+    REQUIRE( G.findPass("geometryPass") == geometryPass );
+    REQUIRE( G.findPass("Final") == Final );
+    REQUIRE( !G.findPass("doesNotExist").valid() );
+
+    auto C1 = G.findTarget("C1");
+    auto D1 = G.findTarget("D1");
+
+    REQUIRE( passes.getOutputs(geometryPass).size() == 2 );
+    REQUIRE( passes.getOutputs(geometryPass)[0] == C1 );
+    REQUIRE( passes.getOutputs(geometryPass)[1] == D1 );
+    REQUIRE( passes.getInputs(geometryPass).size() == 0 );
+
+    REQUIRE( passes.getInputs(Final).size() == 2 );
+    REQUIRE( passes.getOutputs(Final).size() == 0 );
+
+    REQUIRE( targets.writer[C1.index] == geometryPass );
+    REQUIRE( targets.getReaders(C1).size() == 1 );
+    REQUIRE( targets.getReaders(C1)[0] == Final );
+    REQUIRE( targets.format[D1.index] == FrameGraphFormat::D32_SFLOAT );
+
+    REQUIRE( targets.image[C1.index].valid() );
+    REQUIRE( targets.image[D1.index].valid() );
+    REQUIRE( targets.image[C1.index] != targets.image[D1.index] );
+}
+
+SCENARIO("Execution order of a deep diamond graph visits each node once")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    // each level has two passes which both read both outputs
+    // of the previous level. The number of paths doubles per level
+    uint32_t levels = 40;
+
+    G.createRenderPass("root")
+     .output("L0_a", FrameGraphFormat::R8G8B8A8_UNORM)
+     .output("L0_b", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    for(uint32_t i=1;i<levels;i++)
+    {
+        auto prevA = "L" + std::to_string(i-1) + "_a";
+        auto prevB = "L" + std::to_string(i-1) + "_b";
+        G.createRenderPass("P" + std::to_string(i) + "_a")
+         .input(prevA)
+         .input(prevB)
+         .output("L" + std::to_string(i) + "_a", FrameGraphFormat::R8G8B8A8_UNORM);
+        G.createRenderPass("P" + std::to_string(i) + "_b")
+         .input(prevA)
+         .input(prevB)
+         .output("L" + std::to_string(i) + "_b", FrameGraphFormat::R8G8B8A8_UNORM);
+    }
+
+    G.createRenderPass("Final")
+     .input("L" + std::to_string(levels-1) + "_a")
+     .input("L" + std::to_string(levels-1) + "_b");
+
+    G.finalize();
+
+    auto order = G.findExecutionOrder();
+    REQUIRE( order.size() == G.getPasses().size() );
+    REQUIRE( order.front() == G.findPass("root") );
+    REQUIRE( order.back()  == G.findPass("Final") );
+}
+
+SCENARIO("Cycles in the graph are reported")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("A")
+     .input("T2")
+     .output("T1", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("B")
+     .input("T1")
+     .output("T2", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    REQUIRE_THROWS_AS( G.finalize(), std::runtime_error );
+}
+
+SCENARIO("Render targets with non-overlapping lifetimes share images")
+{
+    using namespace gfg;
+
+    GIVEN("A long chain of post processing passes")
+    {
+        FrameGraph G;
+        uint32_t passCount = 40;
+
+        G.createRenderPass("geometryPass")
+         .output("T0", FrameGraphFormat::R8G8B8A8_UNORM);
+
+        for(uint32_t i=1;i<passCount;i++)
+        {
+            G.createRenderPass("post" + std::to_string(i))
+             .input("T" + std::to_string(i-1))
+             .output("T" + std::to_string(i), FrameGraphFormat::R8G8B8A8_UNORM);
+        }
+        G.createRenderPass("Final")
+         .input("T" + std::to_string(passCount-1));
+
+        G.finalize();
+
+        THEN("Only two images are ping-ponged")
+        {
+            auto & info = G.getImageAllocationInfo();
+            REQUIRE( info.renderTargetCount == passCount );
+            REQUIRE( info.imageCount == 2 );
+            REQUIRE( info.peakLiveTargets == 2 );
+            REQUIRE( G.getImages().size() == 2 );
+            REQUIRE( G.calculateImageByteSize(100,100) == 2*100*100*4 );
+        }
+        THEN("Only images with a fixed extent are counted before the swapchain's size is known")
+        {
+            REQUIRE( G.getImageAllocationInfo().peakImageBytes == 0 );
+
+            G.updateImageAllocationInfo(100,100);
+            REQUIRE( G.getImageAllocationInfo().peakImageBytes == 2*100*100*4 );
+        }
+    }
+
+    GIVEN("The two pass blur graph")
+    {
+        FrameGraph G;
+
+        G.createRenderPass("geometryPass")
+         .output("C1", FrameGraphFormat::R8G8B8A8_UNORM)
+         .output("D1", FrameGraphFormat::D32_SFLOAT);
+
+        G.createRenderPass("HBlur1")
+         .setExtent(256,256)
+         .input("C1")
+         .output("B1h", FrameGraphFormat::R8G8B8A8_UNORM);
+
+        G.createRenderPass("VBlur1")
+         .setExtent(256,256)
+         .input("B1h")
+         .output("B1v",FrameGraphFormat::R8G8B8A8_UNORM);
+
+        G.createRenderPass("HBlur2")
+         .setExtent(256,256)
+         .input("B1v")
+         .output("B2h", FrameGraphFormat::R8G8B8A8_UNORM);
+
+        G.createRenderPass("Final")
+         .input("B2h")
+         .input("C1");
+
+        G.finalize();
+
+        auto & T = G.getTargets();
+        auto image = [&](std::string const & n)
+        {
+            return T.image[G.findTarget(n).index];
+        };
+
+        THEN("Targets alive at the same time use different images")
+        {
+            REQUIRE( image("C1")  != image("B1h") );
+            REQUIRE( image("B1h") != image("B1v") );
+            REQUIRE( image("B1v") != image("B2h") );
+        }
+        THEN("A target whose lifetime has ended is reused")
+        {
+            REQUIRE( image("B2h") == image("B1h") );
+            REQUIRE( G.getImageAllocationInfo().imageCount == 4 );
+        }
+        THEN("The peak bytes count the images alive during the same pass")
+        {
+            // B1h and B1v are alive together
+            REQUIRE( G.getImageAllocationInfo().peakImageBytes == 2*256*256*4 );
+
+            // while blurring, C1 is alive with them, D1 is already released
+            G.updateImageAllocationInfo(100,100);
+            REQUIRE( G.getImageAllocationInfo().peakImageBytes == 100*100*4 + 2*256*256*4 );
+            REQUIRE( G.calculateImageByteSize(100,100) == 100*100*4 + 100*100*4 + 2*256*256*4 );
+        }
+        THEN("The lifetimes are recorded")
+        {
+            auto C1 = G.findTarget("C1");
+            REQUIRE( T.firstUse[C1.index] == 0 );
+            REQUIRE( T.lastUse[C1.index]  == 4 );
+        }
+    }
+}
+
+SCENARIO("Passes which read at the same pixel are merged into one render pass")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("gBuffer")
+     .output("albedo", FrameGraphFormat::R8G8B8A8_UNORM)
+     .output("normal", FrameGraphFormat::R16G16B16A16_SFLOAT)
+     .output("depth",  FrameGraphFormat::D32_SFLOAT);
+
+    G.createRenderPass("lighting")
+     .inputAttachment("albedo")
+     .inputAttachment("normal")
+     .inputAttachment("depth")
+     .output("lit", FrameGraphFormat::R16G16B16A16_SFLOAT);
+
+    G.createRenderPass("blur")
+     .setExtent(256,256)
+     .input("lit")
+     .output("blurred", FrameGraphFormat::R16G16B16A16_SFLOAT);
+
+    G.createRenderPass("Final")
+     .input("blurred")
+     .input("lit");
+
+    G.finalize();
+
+    auto & passes  = G.getPasses();
+    auto & targets = G.getTargets();
+
+    auto gBuffer  = G.findPass("gBuffer");
+    auto lighting = G.findPass("lighting");
+
+    THEN("The lighting pass is the second subpass of the g-buffer's render pass")
+    {
+        REQUIRE( passes.renderPass[lighting.index] == gBuffer );
+        REQUIRE( passes.subpass[gBuffer.index]     == 0 );
+        REQUIRE( passes.subpass[lighting.index]    == 1 );
+        REQUIRE( passes.getSubpassInputs(lighting).size() == 3 );
+        REQUIRE( passes.getSubpassInputs(lighting)[0] == 1 );
+    }
+
+    THEN("Passes which sample or have different extents are not merged")
+    {
+        REQUIRE( passes.renderPass[G.findPass("blur").index]  == G.findPass("blur") );
+        REQUIRE( passes.renderPass[G.findPass("Final").index] == G.findPass("Final") );
+    }
+
+    THEN("Targets only used inside the render pass are transient")
+    {
+        REQUIRE( targets.transient[G.findTarget("albedo").index] );
+        REQUIRE( targets.transient[G.findTarget("depth").index] );
+        REQUIRE( !targets.transient[G.findTarget("lit").index] );
+
+        auto & img = G.getImages()[targets.image[G.findTarget("albedo").index].index];
+        REQUIRE( img.transient );
+        REQUIRE( img.inputAttachment );
+    }
+
+    THEN("Targets in the same render pass never share an image")
+    {
+        auto albedo = targets.image[G.findTarget("albedo").index];
+        auto normal = targets.image[G.findTarget("normal").index];
+        auto lit    = targets.image[G.findTarget("lit").index];
+        REQUIRE( albedo != normal );
+        REQUIRE( albedo != lit );
+        REQUIRE( normal != lit );
+    }
+}
+
+SCENARIO("Sampling a target of the previous pass prevents merging")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("A")
+     .output("C1", FrameGraphFormat::R8G8B8A8_UNORM)
+     .output("C2", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("B")
+     .inputAttachment("C1")
+     .input("C2")
+     .output("C3", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("Final")
+     .input("C3");
+
+    G.finalize();
+
+    auto & passes = G.getPasses();
+    REQUIRE( passes.renderPass[G.findPass("B").index] == G.findPass("B") );
+    REQUIRE( passes.subpass[G.findPass("B").index] == 0 );
+    REQUIRE( !G.getTargets().transient[G.findTarget("C1").index] );
+}
+
+SCENARIO("Compute passes write storage images and are never merged")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("A")
+     .output("C1", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createComputePass("Blur")
+     .storageInput("C1")
+     .output("C2", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("B")
+     .inputAttachment("C2")
+     .output("C3", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("Final")
+     .input("C3");
+
+    G.finalize();
+
+    auto & passes  = G.getPasses();
+    auto & targets = G.getTargets();
+    auto   blur    = G.findPass("Blur");
+    auto   B       = G.findPass("B");
+
+    REQUIRE( passes.type[blur.index] == PassType::COMPUTE );
+    REQUIRE( passes.type[B.index] == PassType::GRAPHICS );
+    REQUIRE( passes.getInputTypes(blur)[0] == InputType::STORAGE );
+
+    REQUIRE( passes.renderPass[blur.index] == blur );
+    REQUIRE( passes.renderPass[B.index] == B );
+
+    auto & images = G.getImages();
+    REQUIRE( images[targets.image[G.findTarget("C1").index].index].storage );
+    REQUIRE( images[targets.image[G.findTarget("C2").index].index].storage );
+}
+
+SCENARIO("Images are only given the usages the graph needs")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("A")
+     .output("C1",    FrameGraphFormat::R8G8B8A8_UNORM)
+     .output("depth", FrameGraphFormat::D32_SFLOAT);
+
+    G.createComputePass("Blur")
+     .storageInput("C1")
+     .output("C2", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("B")
+     .input("C2")
+     .output("C3", FrameGraphFormat::R16G16B16A16_SFLOAT);
+
+    G.createRenderPass("Final")
+     .input("C3");
+
+    G.finalize();
+
+    auto & targets = G.getTargets();
+    auto & images  = G.getImages();
+    auto & C1      = images[targets.image[G.findTarget("C1").index].index];
+    auto & C2      = images[targets.image[G.findTarget("C2").index].index];
+    auto & depth   = images[targets.image[G.findTarget("depth").index].index];
+
+    THEN("An attachment which is never read is transient")
+    {
+        REQUIRE( targets.transient[G.findTarget("depth").index] );
+        REQUIRE( depth.transient );
+        REQUIRE( depth.attachment );
+        REQUIRE( !depth.sampled );
+    }
+
+    THEN("Images are only sampled or rendered to when a pass does so")
+    {
+        REQUIRE( C1.attachment );
+        REQUIRE( C1.storage );
+        REQUIRE( !C1.sampled );
+
+        REQUIRE( !C2.attachment );
+        REQUIRE( C2.storage );
+        REQUIRE( C2.sampled );
+    }
+
+    THEN("Targets read outside their render pass are not transient")
+    {
+        REQUIRE( !targets.transient[G.findTarget("C1").index] );
+        REQUIRE( !targets.transient[G.findTarget("C2").index] );
+    }
+}
+
+SCENARIO("Buffers order passes and share memory when their lifetimes do not overlap")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    // Cull only communicates with Draw through a buffer
+    G.createRenderPass("Draw")
+     .inputBuffer("drawArgs")
+     .output("C1", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createComputePass("Cull")
+     .outputBuffer("drawArgs", 256, BufferUsage::INDIRECT | BufferUsage::STORAGE);
+
+    G.createComputePass("Histogram")
+     .input("C1")
+     .outputBuffer("histogram", 256);
+
+    G.createRenderPass("Final")
+     .input("C1")
+     .inputBuffer("histogram");
+
+    G.finalize();
+
+    auto & order = G.getExecutionOrder();
+    REQUIRE( order.size() == 4 );
+    REQUIRE( order[0] == G.findPass("Cull") );
+    REQUIRE( order[1] == G.findPass("Draw") );
+
+    auto & passes = G.getPasses();
+    REQUIRE( passes.level[G.findPass("Draw").index] == 1 );
+    REQUIRE( passes.getInputBuffers(G.findPass("Draw")).size() == 1 );
+    REQUIRE( passes.getOutputBuffers(G.findPass("Cull"))[0] == G.findBuffer("drawArgs") );
+
+    auto & bufferTable = G.getBufferTable();
+    auto   drawArgs    = G.findBuffer("drawArgs");
+    auto   histogram   = G.findBuffer("histogram");
+    REQUIRE( bufferTable.getReaders(drawArgs).size() == 1 );
+    REQUIRE( bufferTable.firstUse[drawArgs.index] == 0 );
+    REQUIRE( bufferTable.lastUse[drawArgs.index] == 1 );
+
+    // drawArgs is no longer needed when histogram is written
+    REQUIRE( bufferTable.allocation[drawArgs.index] == bufferTable.allocation[histogram.index] );
+    REQUIRE( G.getBuffers().size() == 1 );
+
+    auto usage = G.getBuffers()[0].usage;
+    REQUIRE( hasUsage(usage, BufferUsage::INDIRECT | BufferUsage::STORAGE) );
+    REQUIRE( !hasUsage(usage, BufferUsage::UNIFORM) );
+}
+
+SCENARIO("Reading a buffer which is never written is reported")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("Final")
+     .inputBuffer("missing");
+
+    REQUIRE_THROWS_AS( G.finalize(), std::out_of_range );
+}
+
+SCENARIO("Async compute passes are split into batches which wait only on the other queue")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("GBuffer")
+     .output("G", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("Shadow")
+     .output("SM", FrameGraphFormat::D32_SFLOAT);
+
+    G.createComputePass("SSAO")
+     .setAsyncCompute()
+     .input("G")
+     .output("AO", FrameGraphFormat::R8_UNORM);
+
+    G.createRenderPass("Lighting")
+     .input("G")
+     .input("SM")
+     .input("AO")
+     .output("C", FrameGraphFormat::R16G16B16A16_SFLOAT);
+
+    G.createRenderPass("Final")
+     .input("C");
+
+    G.finalize();
+
+    auto & passes  = G.getPasses();
+    auto & batches = G.getQueueBatches();
+
+    // GBuffer | Shadow    | Lighting, Final
+    //         | SSAO      |
+    REQUIRE( batches.size() == 4 );
+
+    REQUIRE( batches[0].queue == QueueType::GRAPHICS );
+    REQUIRE( batches[0].passes == std::vector<uint32_t>{0} );
+    REQUIRE( batches[0].wait == QueueBatch::noWait );
+    REQUIRE( batches[0].waitPreviousFrame ); // SSAO read G in the previous frame
+
+    // Shadow does not need SSAO, so it is not waited on
+    REQUIRE( batches[1].queue == QueueType::GRAPHICS );
+    REQUIRE( batches[1].passes == std::vector<uint32_t>{1} );
+    REQUIRE( batches[1].wait == QueueBatch::noWait );
+    REQUIRE( !batches[1].waitPreviousFrame );
+
+    REQUIRE( batches[2].queue == QueueType::COMPUTE );
+    REQUIRE( batches[2].indexInQueue == 0 );
+    REQUIRE( batches[2].wait == 0 );
+
+    REQUIRE( batches[3].queue == QueueType::GRAPHICS );
+    REQUIRE( batches[3].indexInQueue == 2 );
+    REQUIRE( batches[3].passes == std::vector<uint32_t>{3, 4} );
+    REQUIRE( batches[3].wait == 2 );
+
+    REQUIRE( passes.batch[G.findPass("SSAO").index] == 2 );
+
+    auto & images  = G.getImages();
+    auto & targets = G.getTargets();
+    REQUIRE( images[targets.image[G.findTarget("AO").index].index].asyncCompute );
+    REQUIRE( images[targets.image[G.findTarget("G").index].index].asyncCompute );
+    REQUIRE( !images[targets.image[G.findTarget("SM").index].index].asyncCompute );
+}
+
+SCENARIO("Without async compute passes there is a single batch")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("A")
+     .output("C1", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createComputePass("B")
+     .input("C1")
+     .output("C2", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("Final")
+     .input("C2");
+
+    G.finalize();
+
+    auto & batches = G.getQueueBatches();
+    REQUIRE( batches.size() == 1 );
+    REQUIRE( batches[0].passes.size() == 3 );
+    REQUIRE( batches[0].wait == QueueBatch::noWait );
+    REQUIRE( !batches[0].waitPreviousFrame );
+}
+
+SCENARIO("Imported targets have no writer and history targets have two images")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.importTarget("Env", FrameGraphFormat::R8G8B8A8_UNORM, 256, 256);
+
+    G.createRenderPass("Scene")
+     .input("Env")
+     .output("C", FrameGraphFormat::R16G16B16A16_SFLOAT);
+
+    // TAA reads its own output of the previous frame
+    G.createRenderPass("TAA")
+     .input("C")
+     .inputHistory("Acc")
+     .output("Acc", FrameGraphFormat::R16G16B16A16_SFLOAT);
+
+    G.createRenderPass("Final")
+     .input("Acc");
+
+    G.finalize();
+
+    auto & images  = G.getImages();
+    auto & targets = G.getTargets();
+    auto & passes  = G.getPasses();
+
+    auto Env = G.findTarget("Env");
+    auto Acc = G.findTarget("Acc");
+
+    REQUIRE( !targets.writer[Env.index].valid() );
+    REQUIRE( images[targets.image[Env.index].index].imported );
+    REQUIRE( images[targets.image[Env.index].index].name == "Env" );
+    REQUIRE( images[targets.image[Env.index].index].width == 256 );
+
+    REQUIRE( G.usesHistory() );
+    REQUIRE( targets.getImage(Acc, 0) != targets.getImage(Acc, 1) );
+    REQUIRE( images[targets.getImage(Acc, 0).index].history );
+    REQUIRE( images[targets.getImage(Acc, 1).index].history );
+    REQUIRE( images[targets.getImage(Acc, 0).index].name == "Acc_img" );
+    REQUIRE( images[targets.getImage(Acc, 1).index].name == "Acc_img_odd" );
+
+    // other targets have a single image
+    auto C = G.findTarget("C");
+    REQUIRE( targets.getImage(C, 0) == targets.getImage(C, 1) );
+
+    auto TAA = G.findPass("TAA");
+    REQUIRE( passes.getHistoryInputs(TAA).size() == 1 );
+    REQUIRE( passes.getHistoryInputs(TAA)[0] == Acc );
+    REQUIRE( passes.history[TAA.index] );
+    REQUIRE( passes.history[G.findPass("Final").index] );
+    REQUIRE( !passes.history[G.findPass("Scene").index] );
+
+    FrameGraph H;
+    H.importTarget("Env", FrameGraphFormat::R8G8B8A8_UNORM);
+    H.createRenderPass("Final")
+     .inputHistory("Env");
+    REQUIRE_THROWS_AS( H.finalize(), std::invalid_argument );
+}
+
+SCENARIO("Imported targets of a graph without passes are alive for the empty frame")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.importTarget("Env", FrameGraphFormat::R8G8B8A8_UNORM, 256, 256);
+
+    G.finalize();
+
+    auto & images = G.getImages();
+    REQUIRE( images.size() == 1 );
+    REQUIRE( images[0].firstUse == 0 );
+    REQUIRE( images[0].lastUse  == 0 );
+}
+
+SCENARIO("Each sampled input keeps the sampler it was declared with")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    SamplerDefinition linearClamp{SamplerFilter::LINEAR, SamplerAddressMode::CLAMP_TO_EDGE};
+
+    G.createRenderPass("A")
+     .output("C1", FrameGraphFormat::R8G8B8A8_UNORM)
+     .output("C2", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("Final")
+     .input("C1", linearClamp)
+     .input("C2")
+     .inputHistory("C1", {SamplerFilter::LINEAR, SamplerAddressMode::REPEAT});
+
+    G.finalize();
+
+    auto & passes   = G.getPasses();
+    auto   F        = G.findPass("Final");
+    auto   samplers = passes.getInputSamplers(F);
+
+    REQUIRE( samplers.size() == 2 );
+    REQUIRE( samplers[0] == linearClamp );
+    REQUIRE( samplers[1] == SamplerDefinition{} );
+    REQUIRE( samplers[1].filter == SamplerFilter::DEFAULT );
+
+    REQUIRE( passes.getHistoryInputSamplers(F).size() == 1 );
+    REQUIRE( passes.getHistoryInputSamplers(F)[0].addressMode == SamplerAddressMode::REPEAT );
+}
+
+// records what resize( ) asks the executor to build
+struct RecordingExecutor : public gfg::ExecutorBase
+{
+    std::vector<gfg::ImageDefinition> images;
+    std::vector<std::string>          passes;
+    std::vector<std::string>          outputs;
+    std::vector<std::string>          destroyedPasses;
+    std::vector<std::string>          destroyedBuffers;
+
+    void generateImage(gfg::ImageDefinition const & imageDef) override { images.push_back(imageDef); }
+    void destroyImage(std::string const &) override {}
+    void postImageGeneration(std::vector<gfg::ImageDefinition> const &) override {}
+    void generateBuffer(gfg::BufferDefinition const &) override {}
+    void destroyBuffer(std::string const & bufferName) override { destroyedBuffers.push_back(bufferName); }
+    void buildFrameBuffer(std::string const & renderPassName, std::vector<std::string> const & outputTargetImages, std::vector<std::string> const &, std::vector<gfg::SamplerDefinition> const &) override { passes.push_back(renderPassName); outputs.insert(outputs.end(), outputTargetImages.begin(), outputTargetImages.end()); }
+    void destroyFrameBuffer(std::string const &) override {}
+    void buildComputePass(std::string const & computePassName, std::vector<std::string> const &, std::vector<std::string> const &, std::vector<gfg::SamplerDefinition> const &) override { passes.push_back(computePassName); }
+    void destroyPass(std::string const & passName) override { destroyedPasses.push_back(passName); }
+    void buildExecutionPlan(gfg::FrameGraph const &) override {}
+    void preResize() override {}
+    void postResize() override {}
+
+    // the executors add the GPU time they read back
+    using gfg::ExecutorBase::_addTiming;
+
+    // the executors copy the prebuilt frame of every pass
+    using gfg::ExecutorBase::_copyFrame;
+};
+
+// counts every allocation made by the test program
+static size_t g_allocationCount = 0;
+
+void* operator new(std::size_t size)
+{
+    g_allocationCount++;
+    if(void * p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void * p) noexcept
+{
+    std::free(p);
+}
+void operator delete(void * p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+SCENARIO("Copying the prebuilt frames of the passes does not allocate")
+{
+    struct TestFrame : public gfg::FrameBase
+    {
+        std::vector<uint32_t> inputAttachments;
+        std::vector<float>    clearValue;
+    };
+
+    TestFrame A;
+    A.inputAttachments = {1, 2, 3};
+    A.clearValue       = {0.0f};
+    TestFrame B;
+    B.inputAttachments = {4};
+    B.clearValue       = {0.0f, 1.0f};
+
+    // reserved for the largest pass, like buildExecutionPlan( ) does
+    TestFrame F;
+    F.inputAttachments.reserve(3);
+    F.clearValue.reserve(2);
+
+    RecordingExecutor E;
+
+    auto before = g_allocationCount;
+    for(uint32_t frame=0;frame<100;frame++)
+    {
+        E._copyFrame(F, A, &TestFrame::inputAttachments, &TestFrame::clearValue);
+        E._copyFrame(F, B, &TestFrame::inputAttachments, &TestFrame::clearValue);
+    }
+    auto after = g_allocationCount;
+
+    REQUIRE( after == before );
+    REQUIRE( E.getFrameAllocations() == 0 );
+    REQUIRE( F.inputAttachments == B.inputAttachments );
+    REQUIRE( F.clearValue == B.clearValue );
+
+    WHEN("A pass is larger than the reserved frame")
+    {
+        TestFrame C;
+        C.inputAttachments = {1, 2, 3, 4, 5};
+
+        before = g_allocationCount;
+        E._copyFrame(F, C, &TestFrame::inputAttachments, &TestFrame::clearValue);
+        after  = g_allocationCount;
+
+        THEN("The allocation is counted")
+        {
+            REQUIRE( after > before );
+            REQUIRE( E.getFrameAllocations() == 1 );
+        }
+    }
+}
+
+SCENARIO("Resizing only rebuilds the images and passes which depend on the window size")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("Shadow")
+     .output("S", FrameGraphFormat::D32_SFLOAT)
+     .setExtent(1024, 1024);
+
+    G.createRenderPass("Geometry")
+     .input("S")
+     .output("C1", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("Final")
+     .input("C1");
+
+    G.finalize();
+
+    RecordingExecutor E;
+    E.resize(G, 800, 600);
+
+    REQUIRE( E.images.size() == 2 );
+    REQUIRE( E.passes.size() == 3 );
+    REQUIRE( E.getResizeStats().imagesCreated == 2 );
+
+    WHEN("The window keeps its size")
+    {
+        E.images.clear();
+        E.passes.clear();
+        E.resize(G, 800, 600);
+
+        THEN("Nothing is rebuilt")
+        {
+            REQUIRE( E.images.empty() );
+            REQUIRE( E.passes.empty() );
+            REQUIRE( E.getResizeStats().passesKept == 3 );
+        }
+    }
+    WHEN("The window changes size")
+    {
+        E.images.clear();
+        E.passes.clear();
+        E.resize(G, 1920, 1080);
+
+        THEN("The fixed size image and the pass which only writes it are kept")
+        {
+            REQUIRE( E.images.size() == 1 );
+            REQUIRE( E.passes == std::vector<std::string>{"Geometry", "Final"} );
+            REQUIRE( E.getResizeStats().imagesDestroyed == 1 );
+            REQUIRE( E.getResizeStats().passesKept == 1 );
+        }
+    }
+}
+
+SCENARIO("Resizing with a smaller graph destroys the buffers and passes it no longer has")
+{
+    using namespace gfg;
+    FrameGraph G1;
+
+    G1.createRenderPass("Geometry")
+      .output("C1", FrameGraphFormat::R8G8B8A8_UNORM)
+      .outputBuffer("counts", 256);
+
+    G1.createRenderPass("Debug")
+      .input("C1")
+      .inputBuffer("counts")
+      .output("D", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G1.createRenderPass("Final")
+      .input("C1")
+      .input("D");
+
+    G1.finalize();
+
+    FrameGraph G2;
+
+    G2.createRenderPass("Geometry")
+      .output("C1", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G2.createRenderPass("Final")
+      .input("C1");
+
+    G2.finalize();
+
+    RecordingExecutor E;
+    E.resize(G1, 800, 600);
+    REQUIRE( E.destroyedPasses.empty() );
+    REQUIRE( E.destroyedBuffers.empty() );
+
+    E.resize(G2, 800, 600);
+
+    REQUIRE( E.destroyedPasses == std::vector<std::string>{"Debug"} );
+    REQUIRE( E.destroyedBuffers.size() == 1 );
+    REQUIRE( E.getResizeStats().passesDestroyed == 1 );
+    REQUIRE( E.getResizeStats().buffersDestroyed == 1 );
+}
+
+SCENARIO("Grow-only images are only reallocated when the window grows")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("Geometry")
+     .output("C1", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("Final")
+     .input("C1");
+
+    G.finalize();
+
+    RecordingExecutor E;
+    E.setGrowOnly(true, 256);
+    E.resize(G, 800, 600);
+
+    REQUIRE( E.images.size() == 1 );
+    REQUIRE( E.getImageWidth() == 1024 );
+    REQUIRE( E.getImageHeight() == 768 );
+    REQUIRE( E.getRenderableWidth() == 800 );
+
+    E.images.clear();
+    E.resize(G, 700, 500);
+
+    REQUIRE( E.images.empty() );
+    REQUIRE( E.getImageWidth() == 1024 );
+    REQUIRE( E.getRenderableWidth() == 700 );
+    REQUIRE( E.getRenderableHeight() == 500 );
+
+    E.setResolutionScale(0.5f);
+    REQUIRE( E.getRenderableWidth() == 350 );
+    REQUIRE( E.getRenderableHeight() == 250 );
+
+    E.setResolutionScale(2.0f);
+    REQUIRE( E.getRenderableWidth() == 1024 );
+    REQUIRE( E.getRenderableHeight() == 768 );
+
+    E.resize(G, 1100, 600);
+    REQUIRE( E.images.size() == 1 );
+    REQUIRE( E.getImageWidth() == 1280 );
+    REQUIRE( E.getImageHeight() == 768 );
+}
+
+SCENARIO("Passes can render at a fraction of the swapchain's size")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("Geometry")
+     .output("C1", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("Half")
+     .input("C1")
+     .output("H1", FrameGraphFormat::R8G8B8A8_UNORM)
+     .setScale(0.5f);
+
+    G.createRenderPass("Quarter")
+     .input("H1")
+     .output("Q1", FrameGraphFormat::R8G8B8A8_UNORM)
+     .setScale(0.25f);
+
+    G.createRenderPass("Half2")
+     .input("Q1")
+     .output("H2", FrameGraphFormat::R8G8B8A8_UNORM)
+     .setScale(0.5f);
+
+    G.createRenderPass("Final")
+     .input("C1")
+     .input("H2");
+
+    G.finalize();
+
+    auto & targets = G.getTargets();
+    auto   H1      = G.findTarget("H1");
+    auto   Q1      = G.findTarget("Q1");
+    auto   H2      = G.findTarget("H2");
+
+    THEN("Targets of the same scale share images")
+    {
+        REQUIRE( targets.getImage(H1, 0) == targets.getImage(H2, 0) );
+        REQUIRE( targets.getImage(Q1, 0) != targets.getImage(H1, 0) );
+        REQUIRE( G.getImages().size() == 3 );
+        REQUIRE( G.calculateImageByteSize(800, 600) == (800*600 + 400*300 + 200*150) * 4 );
+    }
+    THEN("Scaled passes are not merged with full resolution passes")
+    {
+        auto & passes = G.getPasses();
+        REQUIRE( passes.renderPass[G.findPass("Half").index] == G.findPass("Half") );
+    }
+    THEN("The executor resolves the scale when it is resized")
+    {
+        RecordingExecutor E;
+        E.resize(G, 800, 600);
+
+        std::vector<std::pair<uint32_t, uint32_t>> extents;
+        for(auto & I : E.images)
+            extents.push_back({I.width, I.height});
+        std::sort(extents.begin(), extents.end());
+
+        REQUIRE( extents == std::vector<std::pair<uint32_t, uint32_t>>{ {200,150}, {400,300}, {800,600} } );
+    }
+}
+
+SCENARIO("Mips of a render target are written by separate passes")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("Geometry")
+     .output("C1", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("Bright")
+     .input("C1")
+     .output("bloom", FrameGraphFormat::R8G8B8A8_UNORM)
+     .setScale(0.5f);
+
+    G.createRenderPass("Down1")
+     .inputMip("bloom", 0)
+     .outputMip("bloom", 1, FrameGraphFormat::R8G8B8A8_UNORM)
+     .setScale(0.5f);
+
+    G.createRenderPass("Down2")
+     .inputMip("bloom", 1)
+     .outputMip("bloom", 2, FrameGraphFormat::R8G8B8A8_UNORM)
+     .setScale(0.5f);
+
+    G.createRenderPass("Final")
+     .input("C1")
+     .inputMip("bloom", 2);
+
+    G.finalize();
+
+    auto & targets = G.getTargets();
+    auto   B0      = G.findTarget("bloom");
+    auto   B1      = G.findTarget(mipTargetName("bloom", 1));
+    auto   B2      = G.findTarget(mipTargetName("bloom", 2));
+
+    THEN("Each mip is a target which shares the image of the chain")
+    {
+        REQUIRE( B1.valid() );
+        REQUIRE( B2.valid() );
+        REQUIRE( targets.mip[B0.index] == 0 );
+        REQUIRE( targets.mip[B1.index] == 1 );
+        REQUIRE( targets.mip[B2.index] == 2 );
+        REQUIRE( targets.getImage(B1, 0) == targets.getImage(B0, 0) );
+        REQUIRE( targets.getImage(B2, 0) == targets.getImage(B0, 0) );
+        REQUIRE( G.getImages()[targets.getImage(B0, 0).index].mipLevels == 3 );
+    }
+    THEN("Passes writing different mips are not merged")
+    {
+        auto & passes = G.getPasses();
+        REQUIRE( passes.renderPass[G.findPass("Down1").index] == G.findPass("Down1") );
+        REQUIRE( passes.renderPass[G.findPass("Down2").index] == G.findPass("Down2") );
+    }
+    THEN("Every level of the chain is counted in the byte size")
+    {
+        uint64_t geometry = 800 * 600 * 4;
+        uint64_t chain    = (400 * 300 + 200 * 150 + 100 * 75) * 4;
+        REQUIRE( G.calculateImageByteSize(800, 600) == geometry + chain );
+    }
+    THEN("The executor allocates one image and addresses the mips by name")
+    {
+        RecordingExecutor E;
+        E.resize(G, 800, 600);
+
+        auto chain = std::count_if(E.images.begin(), E.images.end(), [](auto & I) { return I.mipLevels == 3; });
+        REQUIRE( chain == 1 );
+        REQUIRE( std::count_if(E.outputs.begin(), E.outputs.end(), [](auto & n) { return n.find("#mip1") != std::string::npos; }) == 1 );
+        REQUIRE( std::count_if(E.outputs.begin(), E.outputs.end(), [](auto & n) { return n.find("#mip2") != std::string::npos; }) == 1 );
+    }
+}
+
+SCENARIO("Multisampled targets are resolved for the passes which read them")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("Geometry")
+     .output("C1", FrameGraphFormat::R8G8B8A8_UNORM, 4)
+     .output("D1", FrameGraphFormat::D32_SFLOAT, 4);
+
+    G.createRenderPass("Tonemap")
+     .inputAttachment("C1")
+     .output("C2", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("Final")
+     .input("C2");
+
+    G.finalize();
+
+    auto & passes  = G.getPasses();
+    auto & targets = G.getTargets();
+    auto   geometry = G.findPass("Geometry");
+    auto   C1       = G.findTarget("C1");
+    auto   D1       = G.findTarget("D1");
+    auto   R1       = G.findTarget(resolveTargetName("C1"));
+
+    THEN("The resolve is written by the same pass, after the target it resolves")
+    {
+        REQUIRE( R1.valid() );
+        REQUIRE( targets.resolve[C1.index] == R1 );
+        REQUIRE( targets.resolveSource[R1.index] == C1 );
+        REQUIRE( !targets.resolve[D1.index].valid() );
+        REQUIRE( targets.writer[R1.index] == geometry );
+        REQUIRE( passes.getOutputs(geometry).size() == 3 );
+        REQUIRE( passes.getOutputs(geometry)[0] == C1 );
+        REQUIRE( passes.getOutputs(geometry)[1] == R1 );
+        REQUIRE( passes.samples[geometry.index] == 4 );
+    }
+    THEN("Readers read the resolve and the multisampled images are transient")
+    {
+        REQUIRE( passes.getInputs(G.findPass("Tonemap"))[0] == R1 );
+        REQUIRE( targets.getReaders(C1).size() == 0 );
+        REQUIRE( targets.transient[C1.index] );
+        REQUIRE( targets.transient[D1.index] );
+        REQUIRE( !targets.transient[R1.index] );
+
+        auto & I = G.getImages()[targets.image[C1.index].index];
+        REQUIRE( I.samples == 4 );
+        REQUIRE( I.transient );
+        REQUIRE( G.getImages()[targets.image[R1.index].index].samples == 1 );
+    }
+    THEN("Passes with different sample counts are not merged")
+    {
+        auto tonemap = G.findPass("Tonemap");
+        REQUIRE( passes.renderPass[tonemap.index] == tonemap );
+    }
+    THEN("Multisampled depth targets can not be read")
+    {
+        G.createRenderPass("Final").input("C2").input("D1");
+        REQUIRE_THROWS_AS( G.finalize(), std::invalid_argument );
+    }
+    THEN("A pass can not render to targets with different sample counts")
+    {
+        G.createRenderPass("Geometry")
+         .output("C1", FrameGraphFormat::R8G8B8A8_UNORM, 4)
+         .output("D1", FrameGraphFormat::D32_SFLOAT);
+        REQUIRE_THROWS_AS( G.finalize(), std::invalid_argument );
+    }
+}
+
+SCENARIO("Attachment load and store ops are derived from the graph")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.importTarget("UI", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("Geometry")
+     .output("C1", FrameGraphFormat::R8G8B8A8_UNORM)
+     .output("D1", FrameGraphFormat::D32_SFLOAT);
+
+    G.createRenderPass("Light")
+     .input("C1")
+     .output("C2", FrameGraphFormat::R8G8B8A8_UNORM)
+     .output("D2", FrameGraphFormat::D32_SFLOAT)
+     .setOverwrite();
+
+    G.createRenderPass("Overlay")
+     .input("C2")
+     .output("UI");
+
+    G.createRenderPass("Final")
+     .input("UI");
+
+    G.finalize();
+
+    auto & passes = G.getPasses();
+    auto _ops = [&](std::string const & name)
+    {
+        auto p     = G.findPass(name);
+        auto load  = passes.getOutputLoadOps(p);
+        auto store = passes.getOutputStoreOps(p);
+        std::vector<std::pair<LoadOp, StoreOp>> ops;
+        for(uint32_t k=0;k<load.size();k++)
+            ops.push_back({load[k], store[k]});
+        return ops;
+    };
+
+    THEN("Targets which are read are stored, the others are not")
+    {
+        REQUIRE( _ops("Geometry") == std::vector<std::pair<LoadOp, StoreOp>>{ {LoadOp::CLEAR, StoreOp::STORE}, {LoadOp::CLEAR, StoreOp::DONT_CARE} } );
+    }
+    THEN("Passes which overwrite their color outputs do not clear them")
+    {
+        REQUIRE( _ops("Light") == std::vector<std::pair<LoadOp, StoreOp>>{ {LoadOp::DONT_CARE, StoreOp::STORE}, {LoadOp::CLEAR, StoreOp::DONT_CARE} } );
+    }
+    THEN("Imported targets are loaded and stored")
+    {
+        REQUIRE( _ops("Overlay") == std::vector<std::pair<LoadOp, StoreOp>>{ {LoadOp::LOAD, StoreOp::STORE} } );
+    }
+}
+
+SCENARIO("Pass timings are kept over the most recent frames")
+{
+    using namespace gfg;
+    FrameGraph G;
+
+    G.createRenderPass("Geometry")
+     .output("C1", FrameGraphFormat::R8G8B8A8_UNORM);
+
+    G.createRenderPass("Final")
+     .input("C1");
+
+    G.finalize();
+
+    RecordingExecutor E;
+    E.setProfilingWindow(3);
+    E.resize(G, 800, 600);
+
+    auto & timings = E.getPassTimings();
+    REQUIRE( timings.size() == 2 );
+    REQUIRE( timings[0].name == "Geometry" );
+    REQUIRE( timings[1].name == "Final" );
+    REQUIRE( timings[0].samples == 0 );
+
+    for(double ms : {4.0, 1.0, 2.0, 3.0})
+    {
+        E._addTiming(0, ms);
+    }
+
+    THEN("The oldest frame has left the window")
+    {
+        REQUIRE( timings[0].samples == 3 );
+        REQUIRE( timings[0].min == 1.0 );
+        REQUIRE( timings[0].max == 3.0 );
+        REQUIRE( timings[0].avg == 2.0 );
+        REQUIRE( timings[1].samples == 0 );
+    }
+    THEN("Resizing starts the measurements over")
+    {
+        E.resize(G, 1920, 1080);
+        REQUIRE( timings.size() == 2 );
+        REQUIRE( timings[0].samples == 0 );
+        REQUIRE( timings[0].max == 0.0 );
+    }
+}